@@ -0,0 +1,32 @@
+#!/usr/bin/env python
+
+# Times the request path handling of the API, run "python bench/api_bench.py" from the package.
+# Needs a sourced and built ROS workspace as the API imports rospy and sac_msgs and reads the arm profiles.
+import os
+import sys
+import timeit
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "scripts"))
+import api_controller
+
+requestPath = "/0.237558/0.237558/0.2/0.0/1.5707963/0.065/2.0"
+
+def run(name, statement, minTime=0.2):
+    number = 1
+    while True:
+        seconds = timeit.timeit(statement, number=number)
+        if seconds >= minTime:
+            break
+        number *= 10
+    print("%-40s %14.1f %14s %12d" % (name, seconds * 1e9 / number, "-", number))
+
+def main():
+    print("%-40s %14s %14s %12s" % ("benchmark", "ns/op", "allocs/op", "iterations"))
+    run("api/parseTarget", lambda: api_controller.parseTarget(requestPath))
+
+    profile = api_controller.loadProfiles(api_controller.profilePath())["scorbot"]
+    target = api_controller.parseTarget(requestPath)
+    run("api/checkTarget", lambda: api_controller.checkTarget(profile, False, *target[:6]))
+
+if __name__ == "__main__":
+    main()
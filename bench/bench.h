@@ -0,0 +1,78 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+// A small microbenchmark harness, every benchmark is run for long enough to time and the
+// time and heap allocations per operation are printed.
+// The allocation count comes from the operator new defined in the file which runs the benchmarks.
+namespace bench
+{
+    inline size_t &allocations()
+    {
+        static size_t count = 0;
+        return count;
+    }
+
+    // Keeps the compiler from dropping a result which is never used.
+    template <class T>
+    inline void keep(const T &value)
+    {
+        asm volatile("" : : "r"(&value) : "memory");
+    }
+
+    class runner
+    {
+        public:
+            // Only benchmarks with the filter in their name are run.
+            runner(const char *filter = 0, double minTime = 0.2) :
+                filter(filter),
+                minTime(minTime)
+            {
+                std::printf("%-40s %14s %14s %12s\n", "benchmark", "ns/op", "allocs/op", "iterations");
+            }
+
+            // f runs the operation n times.
+            template <class F>
+            void run(const char *name, F f)
+            {
+                if (filter && !std::strstr(name, filter))
+                    return;
+
+                f(1); // warm up
+
+                size_t n = 1;
+                double seconds = 0;
+                size_t allocated = 0;
+
+                while (true)
+                {
+                    size_t before = allocations();
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                    f(n);
+
+                    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    allocated = allocations() - before;
+
+                    if (seconds >= minTime || n >= ((size_t)1 << 40))
+                        break;
+
+                    // aim a little past the minimum time on the next try
+                    n = seconds <= 0 ? n * 100 : (size_t)(n * std::min(100.0, 1.2 * minTime / seconds)) + 1;
+                }
+
+                std::printf("%-40s %14.1f %14.2f %12zu\n", name, seconds * 1e9 / n, (double)allocated / n, n);
+            }
+
+        private:
+            const char *filter;
+            double minTime;
+    };
+}
+
+#endif // BENCH_H
@@ -0,0 +1,237 @@
+// microbenchmarks for the hot paths of the controllers, run "rosrun sac_controllers sac_controllers_bench [filter]"
+#include "bench.h"
+#include "../src/helpers/hanoi.h"
+#include "../src/helpers/plan_search.h"
+#include "../src/helpers/reachability.h"
+#include "../src/helpers/selector.h"
+#include "../src/helpers/trajectory.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <ros/ros.h>
+#include <sac_msgs/Target.h>
+#include <sac_msgs/HandPos.h>
+#include <sac_msgs/Path.h>
+
+// count every heap allocation
+void *operator new(size_t size)
+{
+    bench::allocations()++;
+
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// the selector keeps its state in statics, here a node which is selected
+int benchIdent = 1;
+int benchSelected = 1;
+int *selector::nodeIdent = &benchIdent;
+int *selector::selNum = &benchSelected;
+
+namespace benchmarks
+{
+    const float pi = 3.1415926535898;
+
+    // the Towers of Hanoi layout from the towers controller
+    const hanoi::layout pegLayout = {
+        { { 0.000000, 0.336000 }, { 0.237558, 0.237558 }, { 0.336000, 0.000000 } },
+        { 0.040, 0.030, 0.020 },
+        { 0.038, 0.028, 0.018 },
+        0.065, 0.200, 0.005, 0.010, 0.000000, pi / 2
+    };
+
+    // the profile waits for a full segment of each kind, the same for every load
+    const float unit[4][payload::numLoads] = { { 9, 9, 9, 9 }, { 5, 5, 5, 5 }, { 10, 10, 10, 10 }, { 5, 5, 5, 5 } };
+}
+
+// Serializes a message into a buffer which is reused, as publishing does for every subscriber.
+template <class M>
+void serialize(const M &msg, std::vector<uint8_t> &buffer)
+{
+    uint32_t length = ros::serialization::serializationLength(msg);
+
+    if (buffer.size() < length)
+        buffer.resize(length);
+
+    ros::serialization::OStream stream(buffer.data(), length);
+    ros::serialization::serialize(stream, msg);
+}
+
+int main(int argc, char **argv)
+{
+    bench::runner runner(argc > 1 ? argv[1] : 0);
+
+    // plan generation
+    for (int blocks = 3; blocks <= hanoi::maxBlocks; blocks++)
+    {
+        char name[64];
+        std::vector<hanoi::move> plan;
+
+        plan.reserve(1 << hanoi::maxBlocks);
+        std::snprintf(name, sizeof(name), "hanoi::solve/%d", blocks);
+        runner.run(name, [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                plan.clear();
+                hanoi::solve(blocks, 0, 2, plan);
+                bench::keep(plan);
+            }
+        });
+    }
+
+    runner.run("search::best/3", [&](size_t n)
+    {
+        std::vector<search::options> opts = search::candidates(0, -1, benchmarks::pegLayout.raised);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            search::plan best = search::best(opts, 3, 0, benchmarks::pegLayout, benchmarks::unit,
+                                             [](const hanoi::waypoint &) { return true; }, 1);
+            bench::keep(best);
+        }
+    });
+
+    // waypoint expansion
+    {
+        std::vector<hanoi::waypoint> path;
+        hanoi::world world(3, 0);
+
+        path.reserve(16);
+        runner.run("hanoi::expand", [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                path.clear();
+                hanoi::expand(world, { 0, 2 }, benchmarks::pegLayout, path);
+                bench::keep(path);
+            }
+        });
+
+        search::plan plan = search::build({ 1, 0, 0.010 }, 3, 0, benchmarks::pegLayout);
+        runner.run("search::expand", [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                path.clear();
+                search::expand(plan, 0, world, benchmarks::pegLayout, path);
+                bench::keep(path);
+            }
+        });
+    }
+
+    runner.run("reach::check", [&](size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            reach::target t = { 0.237558f, 0.237558f, 0.05f + 0.0001f * (i % 100), 0, benchmarks::pi / 2, 0.03f };
+            reach::status result = reach::check<arms::scorbot>(t, false);
+            bench::keep(result);
+        }
+    });
+
+    // time optimal timing of a quarter turn carrying the largest block
+    {
+        hanoi::waypoint from = { 0.000000, 0.336000, 0.200, 0, benchmarks::pi / 2, 0.038, hanoi::raiseSegment, 0 };
+        hanoi::waypoint to = { 0.336000, 0.000000, 0.200, 0, benchmarks::pi / 2, 0.038, hanoi::rotateSegment, 0 };
+        runner.run("topp::duration", [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                float time = topp::duration(arms::scorbot::table(), from, to, payload::profiles[payload::heavy]);
+                bench::keep(time);
+            }
+        });
+    }
+
+    // message serialization
+    {
+        std::vector<uint8_t> buffer;
+        sac_msgs::Target target;
+        sac_msgs::HandPos hand;
+        sac_msgs::Path path;
+        std::vector<hanoi::waypoint> move;
+        hanoi::world world(3, 0);
+
+        target.x = 0.237558;
+        target.y = 0.237558;
+        target.z = 0.2;
+        target.pitch = benchmarks::pi / 2;
+        hand.width = 0.065;
+
+        // a path of the eight targets of one Hanoi move (Path.msg is a Target[] path)
+        hanoi::expand(world, { 0, 2 }, benchmarks::pegLayout, move);
+        for (size_t i = 0; i < move.size(); i++)
+        {
+            sac_msgs::Target t;
+
+            t.x = move[i].x;
+            t.y = move[i].y;
+            t.z = move[i].z;
+            t.roll = move[i].roll;
+            t.pitch = move[i].pitch;
+            t.time = 2;
+            path.path.push_back(t);
+        }
+
+        runner.run("serialize/Target", [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                serialize(target, buffer);
+                bench::keep(buffer);
+            }
+        });
+
+        runner.run("serialize/HandPos", [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                serialize(hand, buffer);
+                bench::keep(buffer);
+            }
+        });
+
+        runner.run("serialize/Path", [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                serialize(path, buffer);
+                bench::keep(buffer);
+            }
+        });
+
+        runner.run("serializeMessage/Target", [&](size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                ros::SerializedMessage message = ros::serialization::serializeMessage(target);
+                bench::keep(message);
+            }
+        });
+    }
+
+    // selector checks
+    runner.run("selector::isSelected", [&](size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            bool on = selector::isSelected();
+            bench::keep(on);
+        }
+    });
+}
@@ -7,29 +7,290 @@ from std_msgs.msg import String
 from sac_msgs.msg import Path
 from sac_msgs.msg import Target
 from sac_msgs.msg import HandPos
+from sensor_msgs.msg import JointState
+from std_msgs.msg import Int32MultiArray
+from catkin.find_in_workspaces import find_in_workspaces
 
 # Web Server
-import string, cgi, time
+import string, cgi, time, math, json
+import socket, struct, threading, urlparse
 from os import curdir, sep
 from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+from SocketServer import ThreadingMixIn
 
 # This should be moved to a post later but it is a get for now to make the initial writing faster
 # Change the message type when the type gets figured out
 
 # NOTE :: This code is not my own, It can be found at several sources here is one: pymotw.com/2/BaseHTTPServer
 
+# Telemetry stream
+# GET [ip]:8080/stream?rate=20&delta=1 returns a chunked stream of binary frames (little endian).
+# The rate is in Hz and is clamped to minRate..maxRate, a rate which is not a positive number gets a 400.
+# Every frame starts with a 12 byte header:
+#   uint8 magic ('T'), uint8 type (0 key, 1 delta), uint16 flags, uint32 seq, uint32 stamp (ms since the stream opened)
+# The low flag bits say which fields follow (in this order):
+#   bit 0 joints   uint8 count, uint16 mask, int16 position (mrad) for each joint in the mask
+#   bit 1 target   int16 x, y, z (0.1 mm), int16 roll, pitch (mrad)
+#   bit 2 grip     uint16 width (0.01 mm)
+#   bit 3 progress uint16 done, uint16 total
+# bit 8 is set while the arm is settled, a joint has moved since the last command and none has moved
+# for settle_time seconds since (planning takes longer than settle_time, so a quiet arm alone is not settled).
+# A command to where the arm already is never moves a joint, so the arm is also settled once settle_time
+# has passed since the command and the last joint state puts the tool within target_tolerance of the target.
+# Key frames carry every field, delta frames only the fields and joints which changed.
+frameMagic = ord("T")
+keyFrame = 0
+deltaFrame = 1
+
+jointsField = 0x01
+targetField = 0x02
+gripField = 0x04
+progressField = 0x08
+settledFlag = 0x100
+
+maxJoints = 16
+
+# stream rates in Hz, faster than maxRate only spins the server thread
+minRate = 1.0
+maxRate = 100.0
+
+def clampRate(rate):
+    return min(max(rate, minRate), maxRate)
+
+def quantize(value, scale):
+    return max(-32768, min(32767, int(round(value * scale))))
+
+class telemetry:
+    def __init__(self, settleTime, settleTolerance, targetTolerance):
+        self.lock = threading.Lock()
+        self.settleTime = settleTime
+        self.settleTolerance = settleTolerance
+        self.targetTolerance = targetTolerance
+        self.pose = None
+        self.goal = None
+        self.joints = ()
+        self.target = (0, 0, 0, 0, 0)
+        self.grip = 0
+        self.progress = (0, 0)
+        self.lastMotion = time.time()
+        self.lastCommand = 0
+
+    def jointCallback(self, msg):
+        joints = tuple(quantize(p, 1000) for p in msg.position[:maxJoints])
+        pose = toolPosition(profile, msg.position) if profile is not None else None
+        with self.lock:
+            self.pose = pose
+            if len(joints) != len(self.joints) or \
+               any(abs(a - b) > self.settleTolerance * 1000 for a, b in zip(joints, self.joints)):
+                self.lastMotion = time.time()
+            self.joints = joints
+
+    def targetCallback(self, msg):
+        with self.lock:
+            self.target = (quantize(msg.x, 10000), quantize(msg.y, 10000), quantize(msg.z, 10000),
+                           quantize(msg.roll, 1000), quantize(msg.pitch, 1000))
+            self.goal = (msg.x, msg.y, msg.z)
+            self.lastCommand = time.time()
+            # only a joint state from after the command can show the arm at the target
+            self.pose = None
+
+    def handCallback(self, msg):
+        with self.lock:
+            self.grip = max(0, min(65535, int(round(msg.width * 100000))))
+            self.lastCommand = time.time()
+
+    def progressCallback(self, msg):
+        if len(msg.data) >= 2:
+            with self.lock:
+                self.progress = (max(0, min(65535, msg.data[0])), max(0, min(65535, msg.data[1])))
+
+    def atTarget(self):
+        return self.pose is not None and self.goal is not None and \
+               math.sqrt(sum((a - b) ** 2 for a, b in zip(self.pose, self.goal))) <= self.targetTolerance
+
+    def snapshot(self):
+        with self.lock:
+            now = time.time()
+            quiet = now - self.lastMotion >= self.settleTime
+            settled = quiet and (self.lastMotion > self.lastCommand or
+                                 (now - self.lastCommand >= self.settleTime and self.atTarget()))
+            return (self.joints, self.target, self.grip, self.progress, settled)
+
+class frameEncoder:
+    def __init__(self, delta, keyInterval):
+        self.delta = delta
+        self.keyInterval = keyInterval
+        self.seq = 0
+        self.last = None
+        self.lastKey = 0
+
+    # Returns the next frame or None if a delta frame would carry nothing new.
+    def encode(self, state, stamp):
+        joints, target, grip, progress, settled = state
+        key = not self.delta or self.last is None or stamp - self.lastKey >= self.keyInterval or \
+              len(joints) != len(self.last[0])
+
+        if key:
+            flags = jointsField | targetField | gripField | progressField
+            jointMask = (1 << len(joints)) - 1
+            self.lastKey = stamp
+        else:
+            flags = 0
+            jointMask = 0
+            for i in range(len(joints)):
+                if joints[i] != self.last[0][i]:
+                    jointMask |= 1 << i
+            if jointMask:
+                flags |= jointsField
+            if target != self.last[1]:
+                flags |= targetField
+            if grip != self.last[2]:
+                flags |= gripField
+            if progress != self.last[3]:
+                flags |= progressField
+            if flags == 0 and settled == self.last[4]:
+                return None
+
+        if settled:
+            flags |= settledFlag
+
+        frame = struct.pack("<BBHII", frameMagic, keyFrame if key else deltaFrame, flags, self.seq, stamp)
+        if flags & jointsField:
+            values = [joints[i] for i in range(len(joints)) if jointMask & (1 << i)]
+            frame += struct.pack("<BH%dh" % len(values), len(joints), jointMask, *values)
+        if flags & targetField:
+            frame += struct.pack("<5h", *target)
+        if flags & gripField:
+            frame += struct.pack("<H", grip)
+        if flags & progressField:
+            frame += struct.pack("<2H", *progress)
+
+        self.seq += 1
+        self.last = state
+        return frame
+
+# Workspace check
+# The same planar model of the arm as src/helpers/reachability.h.
+# The profiles are written from the tables in src/helpers/arm_profile.h to arm_profiles.json in the
+# package's share folder when the package is built, so there is only one copy of the numbers.
+# joints are (min, max) for the base, shoulder, elbow, pitch and roll.
+
+# The arm_profiles.json of the devel or install space, None if the package has not been built.
+def profilePath():
+    found = find_in_workspaces(search_dirs=["share"], project="sac_controllers", path="arm_profiles.json",
+                               first_match_only=True)
+    return found[0] if found else None
+
+# Reads the profiles written by arm_profile_export, { name: profile }.
+def loadProfiles(path):
+    with open(path) as file:
+        profiles = json.load(file)
+
+    for p in profiles.values():
+        # the planar model only uses the base, shoulder, elbow, pitch and roll
+        p["joints"] = [tuple(limit) for limit in p["joints"][:5]]
+
+    return profiles
+
+def within(limit, angle):
+    return limit[0] <= angle <= limit[1]
+
+def solvable(p, r, z, pitch):
+    wr = r - p["tool"] * math.cos(pitch) - p["shoulderOffset"]
+    wz = z + p["tool"] * math.sin(pitch) - p["shoulderHeight"]
+    a = p["upperArm"]
+    b = p["forearm"]
+    c = (wr * wr + wz * wz - a * a - b * b) / (2 * a * b)
+    if c < -1 or c > 1:
+        return False
+
+    for side in (-1, 1):
+        elbow = side * math.acos(c)
+        shoulder = math.atan2(wz, wr) - math.atan2(b * math.sin(elbow), a + b * math.cos(elbow))
+        wrist = -pitch - shoulder - elbow
+        if within(p["joints"][1], shoulder) and within(p["joints"][2], elbow) and within(p["joints"][3], wrist):
+            return True
+    return False
+
+# The tool position (x, y, z) of the joint positions, the inverse of solvable.
+# The joint states are taken to start with the base, shoulder, elbow, pitch and roll like the profile.
+def toolPosition(p, joints):
+    if len(joints) < 4:
+        return None
+
+    base, shoulder, elbow, wrist = joints[:4]
+    pitch = -(shoulder + elbow + wrist)
+    wr = p["upperArm"] * math.cos(shoulder) + p["forearm"] * math.cos(shoulder + elbow)
+    wz = p["upperArm"] * math.sin(shoulder) + p["forearm"] * math.sin(shoulder + elbow)
+    r = wr + p["tool"] * math.cos(pitch) + p["shoulderOffset"]
+    z = wz - p["tool"] * math.sin(pitch) + p["shoulderHeight"]
+    return (r * math.cos(base), r * math.sin(base), z)
+
+# Returns the (possibly clamped) target or raises ValueError with the reason it can not be reached.
+def checkTarget(p, clamp, x, y, z, roll, pitch, hand):
+    r = math.hypot(x, y)
+
+    if not p["minGrip"] <= hand <= p["maxGrip"]:
+        if not clamp:
+            raise ValueError("the grip width is outside of the gripper range")
+        hand = min(max(hand, p["minGrip"]), p["maxGrip"])
+
+    if not p["minHeight"] <= z <= p["maxHeight"] or r > p["maxReach"]:
+        if not clamp:
+            raise ValueError("the target is outside of the workspace bounds")
+        z = min(max(z, p["minHeight"]), p["maxHeight"])
+        if r > p["maxReach"]:
+            x *= p["maxReach"] / r
+            y *= p["maxReach"] / r
+            r = p["maxReach"]
+
+    if (r > 0 and not within(p["joints"][0], math.atan2(y, x))) or not within(p["joints"][4], roll):
+        raise ValueError("the base or roll is outside of its joint limits")
+
+    if not solvable(p, r, z, pitch):
+        raise ValueError("no arm pose reaches the target")
+
+    return x, y, z, roll, pitch, hand
+
+class threadedServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+state = None
+profile = None
+clampTargets = False
+streamRate = 20.0
+streamDelta = True
+keyInterval = 1.0
+
+# Reads /x/y/z/roll/pitch/hand/time from a request path, raises ValueError with the reason if it is malformed.
+def parseTarget(requestPath):
+    path = requestPath.split("?")[0].split("/")
+    if len(path) != 8 or path[0] != "":
+        raise ValueError("the path must be /x/y/z/roll/pitch/hand/time")
+
+    try:
+        values = tuple(float(value) for value in path[1:8])
+    except ValueError:
+        raise ValueError("every part of the path must be a number")
+
+    if any(math.isnan(value) or math.isinf(value) for value in values):
+        raise ValueError("every part of the path must be a finite number")
+
+    return values
+
 class handler(BaseHTTPRequestHandler):
     def do_GET(self):
-        path = self.path.split("/")
+        if self.path.startswith("/stream"):
+            self.stream()
+            return
+
         # print x, y, z, theta, time
-	print(path)
-        x = float(path[1])
-        y = float(path[2])
-        z = float(path[3])
-        roll = float(path[4])
-        pitch = float(path[5])
-        hand = float(path[6])
-        time = float(path[7])
+	print(self.path)
+        try:
+            x, y, z, roll, pitch, hand, time = parseTarget(self.path)
+        except ValueError as e:
+            self.send_error(400, str(e))
+            return
 
 	print("")
 	print("x", x)
@@ -41,6 +302,13 @@ class handler(BaseHTTPRequestHandler):
 	print("t", time)
 	print("")
 
+        if profile is not None:
+            try:
+                x, y, z, roll, pitch, hand = checkTarget(profile, clampTargets, x, y, z, roll, pitch, hand)
+            except ValueError as e:
+                self.send_error(422, str(e))
+                return
+
         ikPub = rospy.Publisher("moveto", Target, queue_size=10)
         handPub = rospy.Publisher("handDriver", HandPos, queue_size=10)
 
@@ -53,6 +321,43 @@ class handler(BaseHTTPRequestHandler):
         self.send_response(200)
         return
 
+    def stream(self):
+        query = urlparse.parse_qs(urlparse.urlparse(self.path).query)
+        try:
+            rate = float(query.get("rate", [streamRate])[0])
+        except ValueError:
+            self.send_error(400, "rate must be a number")
+            return
+        if math.isnan(rate) or rate <= 0:
+            self.send_error(400, "rate must be positive")
+            return
+        rate = clampRate(rate)
+        delta = str(query.get("delta", [streamDelta])[0]).lower() in ("1", "true")
+
+        # chunked transfer needs a HTTP/1.1 response
+        self.protocol_version = "HTTP/1.1"
+        self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.close_connection = 1
+
+        encoder = frameEncoder(delta, int(keyInterval * 1000))
+        start = time.time()
+        period = 1.0 / rate
+        try:
+            while not rospy.is_shutdown():
+                frame = encoder.encode(state.snapshot(), int((time.time() - start) * 1000))
+                if frame is not None:
+                    self.wfile.write("%x\r\n%s\r\n" % (len(frame), frame))
+                    self.wfile.flush()
+                time.sleep(period)
+            self.wfile.write("0\r\n\r\n")
+        except socket.error:
+            # the client hung up
+            pass
+
     # Not in current use.
     def do_POST(self):
         global rootnode
@@ -72,11 +377,34 @@ class handler(BaseHTTPRequestHandler):
             pass
 
 def main():
+    global state, profile, clampTargets, streamRate, streamDelta, keyInterval
     rospy.init_node("api_controller", anonymous=True)
 
+    arm = rospy.get_param("~arm", "scorbot")
+    profiles = rospy.get_param("~arm_profiles", profilePath())
+    try:
+        profile = loadProfiles(profiles).get(arm)
+        if profile is None:
+            rospy.logwarn("Unknown arm %s, targets will not be checked." % arm)
+    except (IOError, TypeError, ValueError, KeyError):
+        rospy.logwarn("Can not read the arm profiles from %s, targets will not be checked." % profiles)
+    clampTargets = bool(rospy.get_param("~clamp_targets", False))
+
+    streamRate = clampRate(float(rospy.get_param("~stream_rate", streamRate)))
+    streamDelta = bool(rospy.get_param("~stream_delta", streamDelta))
+    keyInterval = float(rospy.get_param("~stream_key_interval", keyInterval))
+    state = telemetry(float(rospy.get_param("~settle_time", 0.25)),
+                      float(rospy.get_param("~settle_tolerance", 0.001)),
+                      float(rospy.get_param("~target_tolerance", 0.005)))
+
+    rospy.Subscriber(rospy.get_param("~joint_states", "joint_states"), JointState, state.jointCallback)
+    rospy.Subscriber("moveto", Target, state.targetCallback)
+    rospy.Subscriber("handDriver", HandPos, state.handCallback)
+    rospy.Subscriber("jobProgress", Int32MultiArray, state.progressCallback)
+
     try:
 	print("1");
-        server = HTTPServer(("", 8080), handler)
+        server = threadedServer(("", 8080), handler)
 	print("2");
         server.serve_forever()
 	print("3");
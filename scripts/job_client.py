@@ -0,0 +1,60 @@
+#!/usr/bin/env python
+
+# Sends pick and place jobs to a job controller or the fleet dispatcher.
+# usage: job_client.py [topic] [--count N] [--rate N] [--seed N]
+# Jobs are [id, pick x, y, z, place x, y, z, grip] at random headings, the pick and place of a job are at
+# the same reach. The andreas arm takes the jobs up to 0.35 m and the scorbot from there out, which is
+# enough to load up several simulated cells on one machine.
+import rospy
+from std_msgs.msg import Float32MultiArray
+import math, random, sys
+
+minReach = 0.30
+maxReach = 0.45
+height = 0.050
+grip = 0.028
+
+def randomJob(id):
+    fields = [float(id)]
+    reach = random.uniform(minReach, maxReach)
+    for i in range(2):
+        heading = random.uniform(-math.pi / 2, math.pi / 2)
+        fields += [reach * math.cos(heading), reach * math.sin(heading), height]
+    return fields + [grip]
+
+def main():
+    args = rospy.myargv(sys.argv)[1:]
+    topic = "/fleet/jobs"
+    count = 20
+    rate = 1.0
+    i = 0
+    while i < len(args):
+        if args[i] == "--count":
+            count = int(args[i + 1])
+            i += 1
+        elif args[i] == "--rate":
+            rate = float(args[i + 1])
+            i += 1
+        elif args[i] == "--seed":
+            random.seed(int(args[i + 1]))
+            i += 1
+        else:
+            topic = args[i]
+        i += 1
+
+    rospy.init_node("job_client", anonymous=True)
+    pub = rospy.Publisher(topic, Float32MultiArray, queue_size=1000)
+
+    # give the subscriber time to connect before the first job
+    while pub.get_num_connections() == 0 and not rospy.is_shutdown():
+        rospy.sleep(0.1)
+
+    for id in range(count):
+        if rospy.is_shutdown():
+            break
+        pub.publish(Float32MultiArray(data=randomJob(id)))
+        if rate > 0:
+            rospy.sleep(1.0 / rate)
+
+if __name__ == "__main__":
+    main()
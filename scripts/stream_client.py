@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+
+# Reads the api_controller telemetry stream.
+# usage: stream_client.py [ip] [--rate N] [--key-only] [--until-settled [timeout]]
+# With --until-settled the client returns as soon as the arm has moved and settled again,
+# which lets scripts wait for a move to finish instead of sleeping for a fixed time.
+import httplib, struct, sys, time
+
+headerSize = 12
+jointsField = 0x01
+targetField = 0x02
+gripField = 0x04
+progressField = 0x08
+settledFlag = 0x100
+
+def read(resp, size):
+    data = resp.read(size)
+    if len(data) != size:
+        raise EOFError()
+    return data
+
+def frames(addr, rate, delta):
+    conn = httplib.HTTPConnection(addr, 8080)
+    conn.request("GET", "/stream?rate=%g&delta=%d" % (rate, 1 if delta else 0))
+    resp = conn.getresponse()
+    if resp.status != 200:
+        raise IOError("stream refused: %d %s" % (resp.status, resp.reason))
+
+    joints = []
+    state = {"joints": joints, "target": None, "grip": None, "progress": None, "settled": False}
+    while True:
+        magic, kind, flags, seq, stamp = struct.unpack("<BBHII", read(resp, headerSize))
+        if magic != ord("T"):
+            raise IOError("bad frame magic")
+
+        if flags & jointsField:
+            count, mask = struct.unpack("<BH", read(resp, 3))
+            del joints[count:]
+            joints.extend([0.0] * (count - len(joints)))
+            for i in range(count):
+                if mask & (1 << i):
+                    joints[i] = struct.unpack("<h", read(resp, 2))[0] / 1000.0
+        if flags & targetField:
+            t = struct.unpack("<5h", read(resp, 10))
+            state["target"] = (t[0] / 10000.0, t[1] / 10000.0, t[2] / 10000.0, t[3] / 1000.0, t[4] / 1000.0)
+        if flags & gripField:
+            state["grip"] = struct.unpack("<H", read(resp, 2))[0] / 100000.0
+        if flags & progressField:
+            state["progress"] = struct.unpack("<2H", read(resp, 4))
+        state["settled"] = bool(flags & settledFlag)
+
+        yield seq, stamp, state
+
+def main():
+    args = sys.argv[1:]
+    addr = "localhost"
+    rate = 20.0
+    delta = True
+    untilSettled = False
+    timeout = None
+
+    i = 0
+    while i < len(args):
+        if args[i] == "--rate":
+            i += 1
+            rate = float(args[i])
+        elif args[i] == "--key-only":
+            delta = False
+        elif args[i] == "--until-settled":
+            untilSettled = True
+            if i + 1 < len(args) and not args[i + 1].startswith("-"):
+                i += 1
+                timeout = float(args[i])
+        else:
+            addr = args[i]
+        i += 1
+
+    start = time.time()
+    moving = False
+    for seq, stamp, state in frames(addr, rate, delta):
+        if untilSettled:
+            moving = moving or not state["settled"]
+            if moving and state["settled"]:
+                return 0
+            if timeout is not None and time.time() - start > timeout:
+                return 1
+        else:
+            print(seq, stamp, state)
+
+if __name__ == "__main__":
+    sys.exit(main())
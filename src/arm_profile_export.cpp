@@ -0,0 +1,50 @@
+// writes the arm profiles to a JSON file for the python API, so both use the tables in helpers/arm_profile.h
+// run "rosrun sac_controllers arm_profile_export arm_profiles.json"
+#include "helpers/arm_profile.h"
+
+#include <cstdio>
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        std::fprintf(stderr, "usage: %s arm_profiles.json\n", argv[0]);
+        return 2;
+    }
+
+    FILE *file = std::fopen(argv[1], "w");
+    const char *separator = "";
+
+    if (!file)
+    {
+        std::fprintf(stderr, "%s: could not be written\n", argv[1]);
+        return 1;
+    }
+
+    std::fprintf(file, "{\n");
+    arms::forEachArm([&](auto arm)
+    {
+        const arms::profile p = decltype(arm)::table();
+
+        std::fprintf(file, "%s  \"%s\": {\n    \"joints\": [", separator, p.name);
+        for (int i = 0; i < p.numJoints; i++)
+            std::fprintf(file, "%s[%.6g, %.6g]", i > 0 ? ", " : "", p.joints[i].min, p.joints[i].max);
+        std::fprintf(file, "],\n");
+        std::fprintf(file, "    \"shoulderHeight\": %.6g, \"shoulderOffset\": %.6g, \"upperArm\": %.6g, "
+                           "\"forearm\": %.6g, \"tool\": %.6g,\n",
+                     p.shoulderHeight, p.shoulderOffset, p.upperArm, p.forearm, p.tool);
+        std::fprintf(file, "    \"maxReach\": %.6g, \"minHeight\": %.6g, \"maxHeight\": %.6g, "
+                           "\"minGrip\": %.6g, \"maxGrip\": %.6g\n  }",
+                     p.maxReach, p.minHeight, p.maxHeight, p.minGrip, p.maxGrip);
+        separator = ",\n";
+    });
+    std::fprintf(file, "\n}\n");
+
+    if (std::fclose(file) != 0)
+    {
+        std::fprintf(stderr, "%s: could not be written\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
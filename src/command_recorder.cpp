@@ -0,0 +1,67 @@
+// records every command sent to the arm so it can be replayed later
+#include "helpers/config.h"
+#include "helpers/recording.h"
+
+#include <ros/ros.h>
+#include <sac_msgs/Target.h>
+#include <sac_msgs/HandPos.h>
+
+#include <string>
+
+namespace recorder
+{
+    // constants
+    const char *nodeName = "command_recorder";
+
+    // variables
+    recording::recorder *log;
+}
+
+int64_t now()
+{
+    ros::Time stamp = ros::Time::now();
+
+    return (int64_t)stamp.sec * 1000000000 + stamp.nsec;
+}
+
+void targetCallback(const sac_msgs::Target::ConstPtr& msg)
+{
+    float values[] = { msg->x, msg->y, msg->z, msg->roll, msg->pitch, msg->time };
+
+    if (!recorder::log->append(now(), recording::targetCommand, values, 6))
+        ROS_WARN_THROTTLE(10, "Could not record a target command.");
+}
+
+void handCallback(const sac_msgs::HandPos::ConstPtr& msg)
+{
+    float values[] = { msg->width, msg->time };
+
+    if (!recorder::log->append(now(), recording::handCommand, values, 2))
+        ROS_WARN_THROTTLE(10, "Could not record a hand command.");
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, recorder::nodeName);
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    std::string path;
+    std::string ns;
+    pnh.param<std::string>("file", path, "commands.rec");
+    pnh.param<std::string>("namespace", ns, ""); // the arm's namespace, e.g. /scorbot
+
+    recording::recorder log(path);
+    if (!log.isOpen())
+    {
+        ROS_ERROR("Could not open the recording %s, %s.", path.c_str(), log.notice().c_str());
+        return 1;
+    }
+    recorder::log = &log;
+    ROS_INFO("Recording to %s after %lu commands.", path.c_str(), (unsigned long)log.count());
+
+    ros::Subscriber targets = nh.subscribe(ns + "/moveto", 1000, targetCallback);
+    ros::Subscriber hand = nh.subscribe(ns + "/handDriver", 1000, handCallback);
+
+    ros::spin();
+}
@@ -0,0 +1,97 @@
+// replays a recording from the command recorder at normal or accelerated speed
+#include "helpers/config.h"
+#include "helpers/recording.h"
+
+#include <ros/ros.h>
+#include <sac_msgs/Target.h>
+#include <sac_msgs/HandPos.h>
+
+#include <string>
+
+namespace replayer
+{
+    // constants
+    const char *nodeName = "command_replayer";
+    const int connectWait = 15; // time to wait for the arm to subscribe
+
+    // publishers
+    ros::Publisher targets;
+    ros::Publisher hand;
+}
+
+void publish(const recording::command &c)
+{
+    if (c.kind == recording::targetCommand)
+    {
+        sac_msgs::Target targetMsg;
+
+        targetMsg.x = c.values[0];
+        targetMsg.y = c.values[1];
+        targetMsg.z = c.values[2];
+        targetMsg.roll = c.values[3];
+        targetMsg.pitch = c.values[4];
+        targetMsg.time = c.values[5];
+        replayer::targets.publish(targetMsg);
+    }
+    else if (c.kind == recording::handCommand)
+    {
+        sac_msgs::HandPos handMsg;
+
+        handMsg.width = c.values[0];
+        handMsg.time = c.values[1];
+        replayer::hand.publish(handMsg);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, replayer::nodeName);
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    std::string path;
+    std::string ns;
+    double speed;
+    bool loop;
+    pnh.param<std::string>("file", path, "commands.rec");
+    pnh.param<std::string>("namespace", ns, ""); // the arm's namespace, e.g. /scorbot
+    pnh.param("speed", speed, 1.0); // 2.0 replays twice as fast, 0 sends everything at once
+    pnh.param("loop", loop, false);
+
+    recording::player recording(path);
+    if (!recording.isOpen())
+    {
+        ROS_ERROR("Could not open the recording %s.", path.c_str());
+        return 1;
+    }
+
+    replayer::targets = nh.advertise<sac_msgs::Target>(ns + "/moveto", 1000);
+    replayer::hand = nh.advertise<sac_msgs::HandPos>(ns + "/handDriver", 1000);
+
+    for (int i = 0; i < replayer::connectWait * 10 && replayer::targets.getNumSubscribers() == 0; i++)
+        usleep(100000);
+
+    ROS_INFO("Replaying %lu commands from %s at %gx.", (unsigned long)recording.count(), path.c_str(), speed);
+
+    do
+    {
+        ros::Time start = ros::Time::now();
+
+        for (uint64_t i = 0; i < recording.count() && ros::ok(); i++)
+        {
+            const recording::command &c = recording[i];
+
+            if (speed > 0)
+            {
+                double offset = (c.stamp - recording[0].stamp) / 1e9 / speed;
+                ros::Duration wait = start + ros::Duration(offset) - ros::Time::now();
+
+                if (wait.toSec() > 0)
+                    wait.sleep();
+            }
+
+            publish(c);
+        }
+    }
+    while (loop && ros::ok());
+}
@@ -0,0 +1,323 @@
+// two (or more) arms solving the Towers of Hanoi together on one set of pegs
+#include "helpers/config.h"
+#include "helpers/arm_profile.h"
+#include "helpers/reachability.h"
+#include "helpers/hanoi.h"
+#include "helpers/cooperative.h"
+
+#include <ros/ros.h>
+#include <sac_msgs/Target.h>
+#include <sac_msgs/HandPos.h>
+#include <std_msgs/Int32MultiArray.h>
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cooperative
+{
+    // constants
+    const char *nodeName = "cooperative_towers_controller";
+    const float pi = 3.1415926535898;
+    const int numBlocks = 3;
+    const int startupWait = 15; // time for the rest of the system to come up
+    const int showWait = 10; // time to show off the finished tower
+
+    // grip widths
+    const float block2Grip = 0.018;
+    const float block1Grip = 0.028;
+    const float block0Grip = 0.038;
+    const float openGrip = 0.065;
+
+    // lift heights
+    const float block2 = 0.020;
+    const float block1 = 0.030;
+    const float block0 = 0.040;
+    const float raised = 0.200;
+    const float lift = 0.005;
+    const float drop = 0.010;
+
+    // the pegs in a row between the arms, in the cell's frame
+    const hanoi::layout pegLayout = {
+        { { 0.336000, 0.160000 }, { 0.336000, 0.000000 }, { 0.336000, -0.160000 } },
+        { block0, block1, block2 },
+        { block0Grip, block1Grip, block2Grip },
+        openGrip, raised, lift, drop, 0.000000, pi / 2
+    };
+    const hanoi::point park = { 0.115000, -0.316000 }; // in the arm's own frame, past the end of the row
+
+    // the first arm stands at the origin of the cell, the second faces it from the other side of the pegs,
+    // any further arm has to be given its ~<arm>/base
+    const int numBases = 2;
+    const coop::base bases[numBases] = { { 0.000000, 0.000000, 0.000000 }, { 0.672000, 0.000000, pi } };
+
+    // variables
+    bool enabled = true;
+    std::atomic<int> done(0); // moves finished in the current half of the cycle
+
+    // publishers
+    ros::Publisher progress;
+}
+
+// One of the arms taking part.
+struct arm
+{
+    std::string name;    // the arm's label in the params
+    std::string profile; // the arm profile it uses
+    coop::armCell cell;
+    ros::Publisher targets;
+    ros::Publisher hand;
+};
+
+void move(const arm &a, const hanoi::waypoint &w)
+{
+    // Arm movement
+    sac_msgs::Target targetMsg;
+
+    targetMsg.x = w.x;
+    targetMsg.y = w.y;
+    targetMsg.z = w.z;
+    targetMsg.pitch = w.pitch;
+    targetMsg.roll = w.roll;
+    a.targets.publish(targetMsg);
+
+    // Hand movement
+    sac_msgs::HandPos handMsg;
+
+    handMsg.width = w.hand;
+    a.hand.publish(handMsg);
+}
+
+void report(int total)
+{
+    std_msgs::Int32MultiArray progressMsg;
+
+    progressMsg.data.push_back(cooperative::done);
+    progressMsg.data.push_back(total);
+    cooperative::progress.publish(progressMsg);
+}
+
+// Reads where an arm stands, its park position and transit height from its params, falling back to the
+// defaults. The pegs are given once in the cell's frame and moved into the arm's frame from its base.
+// Returns false if the arm has no base, an arm without a default base (fallback is NULL) must be given one.
+bool loadCell(ros::NodeHandle &pnh, const std::string &name, const coop::base *fallback,
+              const arms::profile &p, coop::armCell &cell)
+{
+    coop::base b;
+    std::vector<float> values;
+    double raised;
+
+    cell.layout = cooperative::pegLayout;
+    cell.park = cooperative::park;
+
+    if (pnh.getParam("pegs", values) && values.size() == 2 * hanoi::numPegs)
+        for (int i = 0; i < hanoi::numPegs; i++)
+            cell.layout.pegs[i] = { values[2 * i], values[2 * i + 1] };
+
+    if (pnh.getParam(name + "/base", values) && values.size() == 3)
+        b = { values[0], values[1], values[2] };
+    else if (fallback != NULL)
+        b = *fallback;
+    else
+    {
+        ROS_ERROR("The %s has no base, give ~%s/base as [x, y, yaw] in the cell's frame.", name.c_str(), name.c_str());
+        return false;
+    }
+
+    for (int i = 0; i < hanoi::numPegs; i++)
+        cell.layout.pegs[i] = coop::toArm(b, cell.layout.pegs[i]);
+
+    if (pnh.getParam(name + "/park", values) && values.size() == 2)
+        cell.park = { values[0], values[1] };
+
+    // a short arm like the andreas arm can not reach the pegs at the default transit height
+    pnh.param(name + "/raised", raised, (double)cooperative::raised);
+    cell.layout.raised = raised;
+
+    cell.gripTime = p.gripWait;
+    cell.liftTime = p.liftWait;
+    cell.rotTime = p.rotWait;
+    return true;
+}
+
+// Checks every step of an arm against its workspace before anything is moved.
+template <class Arm>
+bool reachable(const std::vector<coop::step> &steps)
+{
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        for (size_t j = 0; j < steps[i].path.size(); j++)
+        {
+            const hanoi::waypoint &w = steps[i].path[j];
+            reach::target t = { w.x, w.y, w.z, w.roll, w.pitch, w.hand };
+            reach::status result = reach::check<Arm>(t, false);
+
+            if (result != reach::reachable)
+            {
+                ROS_ERROR("Move %d can not be done by the %s, (%f, %f, %f) %s.", steps[i].move,
+                          Arm::table().name, w.x, w.y, w.z, reach::reason(result));
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Runs one arm's steps, taking turns in the zones with the other arms.
+template <class Arm>
+void execute(const arm &a, const std::vector<coop::step> &steps, coop::zoneTurns &turns, int total)
+{
+    const coop::step *current = 0;
+    float heading = hanoi::heading(a.cell.park.x, a.cell.park.y);
+
+    for (size_t i = 0; i < steps.size() && ros::ok(); i++)
+    {
+        if (!turns.handOver(current, &steps[i]))
+            return;
+        current = &steps[i];
+
+        for (size_t j = 0; j < steps[i].path.size(); j++)
+        {
+            const hanoi::waypoint &w = steps[i].path[j];
+            float wait;
+
+            move(a, w);
+            if (w.kind == hanoi::rotateSegment)
+                wait = Arm::table().rotWait * std::fabs(hanoi::heading(w.x, w.y) - heading) / (cooperative::pi / 4);
+            else if (w.kind == hanoi::gripSegment)
+                wait = Arm::table().gripWait;
+            else
+                wait = Arm::table().liftWait;
+            ros::Duration(wait).sleep();
+            heading = hanoi::heading(w.x, w.y);
+        }
+
+        if (steps[i].kind == coop::place)
+        {
+            cooperative::done++;
+            report(total);
+        }
+
+        if (steps[i].kind == coop::retreat)
+        {
+            turns.handOver(current, 0);
+            current = 0;
+        }
+    }
+
+    if (current)
+        turns.handOver(current, 0);
+
+    // never leave the other arms waiting for a turn which will not come
+    if (!ros::ok())
+        turns.stop();
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, cooperative::nodeName);
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    std::vector<std::string> names;
+    double clearance;
+
+    if (!pnh.getParam("arms", names))
+    {
+        names.push_back(arms::scorbot::table().name);
+        names.push_back(arms::andreasArm::table().name);
+    }
+    pnh.param("clearance", clearance, 1.0);
+
+    cooperative::progress = nh.advertise<std_msgs::Int32MultiArray>("/jobProgress", 10);
+
+    std::vector<arm> team(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        // two arms of the same kind need their own labels, ~<label>/profile names the arm profile
+        pnh.param<std::string>(names[i] + "/profile", team[i].profile, names[i]);
+
+        bool placed = false;
+        bool known = arms::withArm(team[i].profile, [&](auto profile)
+        {
+            const arms::profile p = decltype(profile)::table();
+            const coop::base *fallback = i < cooperative::numBases ? &cooperative::bases[i] : NULL;
+            std::string ns;
+
+            pnh.param<std::string>(names[i] + "/namespace", ns, p.ns);
+            team[i].name = names[i];
+            placed = loadCell(pnh, names[i], fallback, p, team[i].cell);
+            team[i].targets = nh.advertise<sac_msgs::Target>(ns + "/moveto", 1000);
+            team[i].hand = nh.advertise<sac_msgs::HandPos>(ns + "/handDriver", 1000);
+        });
+
+        if (!known)
+        {
+            ROS_ERROR("Unknown arm %s.", team[i].profile.c_str());
+            return 1;
+        }
+
+        if (!placed)
+            return 1;
+    }
+
+    std::vector<coop::armCell> cells;
+    for (size_t i = 0; i < team.size(); i++)
+        cells.push_back(team[i].cell);
+
+    // there and back again, scheduled a half at a time so the finished tower can be shown
+    std::vector<hanoi::move> there, back;
+    hanoi::solve(cooperative::numBlocks, 0, 2, there);
+    hanoi::solve(cooperative::numBlocks, 2, 0, back);
+
+    coop::schedule halves[2] = {
+        coop::plan(there, hanoi::world(cooperative::numBlocks, 0), cells, clearance),
+        coop::plan(back, hanoi::world(cooperative::numBlocks, 2), cells, clearance)
+    };
+
+    for (int h = 0; h < 2; h++)
+    {
+        ROS_INFO("Half %d takes %.1f s with %zu arms.", h, halves[h].makespan, team.size());
+
+        for (size_t i = 0; i < team.size(); i++)
+        {
+            bool ok = true;
+
+            arms::withArm(team[i].profile, [&](auto profile)
+            {
+                ok = reachable<decltype(profile)>(halves[h].arms[i]);
+            });
+
+            if (!ok)
+                return 1;
+        }
+    }
+
+    sleep(cooperative::startupWait);
+
+    for (int h = 0; cooperative::enabled && ros::ok(); h = 1 - h)
+    {
+        coop::zoneTurns turns;
+        std::vector<std::thread> threads;
+        int total = h == 0 ? there.size() : back.size();
+
+        cooperative::done = 0;
+        for (size_t i = 0; i < team.size(); i++)
+        {
+            arms::withArm(team[i].profile, [&](auto profile)
+            {
+                threads.push_back(std::thread(execute<decltype(profile)>, std::cref(team[i]),
+                                              std::cref(halves[h].arms[i]), std::ref(turns), total));
+            });
+        }
+
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+
+        sleep(cooperative::showWait);
+    }
+}
@@ -0,0 +1,314 @@
+// shares pick and place jobs between the job controllers of several arms
+#include "helpers/config.h"
+#include "helpers/arm_profile.h"
+#include "helpers/reachability.h"
+#include "helpers/hanoi.h"
+#include "helpers/job_queue.h"
+#include "helpers/fleet.h"
+
+#include <ros/ros.h>
+#include <std_msgs/Float32MultiArray.h>
+#include <std_msgs/Int32.h>
+#include <std_msgs/Int32MultiArray.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dispatch
+{
+    // constants
+    const char *nodeName = "fleet_dispatcher";
+    const float pi = 3.1415926535898;
+    const int jobFields = 8; // id, pick x, y, z, place x, y, z, grip
+    const char *cellTopic = "/jobProgress"; // published by the job controller of every cell
+    const float openGrip = 0.065;
+    const float raised = 0.200;
+
+    // the transit height and gripper pose the job controllers use for every job
+    const hanoi::layout transit = {
+        { { 0, 0 }, { 0, 0 }, { 0, 0 } },
+        { 0 },
+        { 0 },
+        openGrip, raised, 0, 0, 0.000000, pi / 2
+    };
+    const jobs::location home = { 0, 0, raised };
+
+    // variables
+    fleet::dispatcher *cells;
+    std::vector<jobs::job> waiting; // jobs which came in before any cell could take them
+    int done = 0;
+
+    // publishers
+    ros::Publisher progress;
+    ros::Publisher finished;
+}
+
+// The topics of one cell.
+struct channel
+{
+    ros::Publisher jobs;
+    ros::Subscriber done;
+};
+
+void report()
+{
+    std_msgs::Int32MultiArray progressMsg;
+
+    progressMsg.data.push_back(dispatch::done);
+    progressMsg.data.push_back(dispatch::done + dispatch::cells->queued() + dispatch::waiting.size());
+    dispatch::progress.publish(progressMsg);
+}
+
+// Checks every waypoint of a job against the arm's workspace, as the job controller will.
+template <class Arm>
+bool acceptable(const jobs::job &j)
+{
+    std::vector<hanoi::waypoint> path;
+
+    jobs::expand(j, dispatch::transit, path);
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        reach::target t = { path[i].x, path[i].y, path[i].z, path[i].roll, path[i].pitch, path[i].hand };
+
+        if (reach::check<Arm>(t, false) != reach::reachable)
+            return false;
+    }
+
+    return true;
+}
+
+// Gives a job to the cell which will finish it first, or holds it until there is a cell.
+void give(const jobs::job &j)
+{
+    if (dispatch::cells->cells().empty())
+    {
+        dispatch::waiting.push_back(j);
+        return;
+    }
+
+    int cell = dispatch::cells->assign(j, ros::Time::now().toSec());
+
+    if (cell < 0)
+        ROS_WARN("Rejecting job %u, no cell can reach it.", j.id);
+    else
+        ROS_DEBUG("Job %u goes to %s.", j.id, dispatch::cells->cells()[cell].ns.c_str());
+}
+
+// Jobs are sent as [id, pick x, y, z, place x, y, z, grip], the same as to a job controller.
+void jobCallback(const std_msgs::Float32MultiArray::ConstPtr& msg)
+{
+    if (msg->data.size() != dispatch::jobFields)
+    {
+        ROS_WARN("Ignoring a job with %zu fields instead of %d.", msg->data.size(), dispatch::jobFields);
+        return;
+    }
+
+    if (!jobs::exactId(msg->data[0]))
+    {
+        ROS_WARN("Ignoring a job with the id %.0f, ids have to be whole numbers below %.0f.", msg->data[0],
+                 jobs::maxId);
+        return;
+    }
+
+    jobs::job j;
+    j.id = (uint32_t)msg->data[0];
+    j.pick = { msg->data[1], msg->data[2], msg->data[3] };
+    j.place = { msg->data[4], msg->data[5], msg->data[6] };
+    j.grip = msg->data[7];
+    j.arrival = ros::Time::now().toSec();
+
+    give(j);
+    report();
+}
+
+void doneCallback(const std::string &ns, const std_msgs::Int32::ConstPtr& msg)
+{
+    if (!dispatch::cells->finished(ns, msg->data, ros::Time::now().toSec()))
+        return;
+
+    dispatch::finished.publish(*msg);
+    dispatch::done++;
+    report();
+}
+
+// The namespaces of the job controllers which are running, from the topics they publish.
+std::vector<std::string> discover(const std::string &own)
+{
+    ros::master::V_TopicInfo topics;
+    std::vector<std::string> found;
+    std::string suffix = dispatch::cellTopic;
+
+    if (!ros::master::getTopics(topics))
+        return found;
+
+    for (size_t i = 0; i < topics.size(); i++)
+    {
+        const std::string &name = topics[i].name;
+
+        if (name.size() <= suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+
+        std::string ns = name.substr(0, name.size() - suffix.size());
+
+        // the dispatcher's own progress and the towers controllers in the root namespace are not cells
+        if (!ns.empty() && ns != own)
+            found.push_back(ns);
+    }
+
+    return found;
+}
+
+// Adds a cell for a namespace, the arm comes from its job controller's ~arm param or the namespace name.
+bool join(ros::NodeHandle &nh, const std::string &ns, std::map<std::string, channel> &links)
+{
+    std::string arm;
+
+    if (!nh.getParam(ns + "/job_controller/arm", arm))
+        arm = ns.substr(ns.rfind('/') + 1);
+
+    bool known = arms::withArm(arm, [&](auto profile)
+    {
+        typedef decltype(profile) Arm;
+
+        dispatch::cells->add(fleet::makeCell(ns, Arm::table(), acceptable<Arm>, dispatch::home));
+    });
+
+    // an unknown arm keeps an empty channel so it is only reported once
+    channel &l = links[ns];
+
+    if (!known)
+    {
+        ROS_WARN("Skipping the cell in %s, unknown arm %s.", ns.c_str(), arm.c_str());
+        return false;
+    }
+
+    l.jobs = nh.advertise<std_msgs::Float32MultiArray>(ns + "/jobs", 1000);
+    l.done = nh.subscribe<std_msgs::Int32>(ns + "/jobDone", 100, [ns](const std_msgs::Int32::ConstPtr& msg)
+    {
+        doneCallback(ns, msg);
+    });
+
+    ROS_INFO("Found a %s cell in %s.", arm.c_str(), ns.c_str());
+    return true;
+}
+
+// Drops a cell which has gone away and gives its jobs to the others.
+void leave(const std::string &ns, std::map<std::string, channel> &links)
+{
+    int cell = dispatch::cells->find(ns);
+
+    links.erase(ns);
+    if (cell < 0)
+        return;
+
+    size_t sent = dispatch::cells->cells()[cell].released.size();
+    std::vector<jobs::job> orphans = dispatch::cells->remove(ns);
+
+    ROS_WARN("Lost the cell in %s, giving out its %zu jobs again.", ns.c_str(), orphans.size());
+    if (sent > 0)
+        ROS_WARN("%zu of them had been sent to %s, check they were not done.", sent, ns.c_str());
+
+    for (size_t i = 0; i < orphans.size(); i++)
+        give(orphans[i]);
+}
+
+// Matches the cells to the job controllers which are running.
+void update(ros::NodeHandle &nh, std::map<std::string, channel> &links)
+{
+    std::vector<std::string> found = discover(nh.getNamespace());
+    std::vector<std::string> gone;
+
+    for (size_t i = 0; i < found.size(); i++)
+        if (!links.count(found[i]))
+            join(nh, found[i], links);
+
+    for (std::map<std::string, channel>::iterator i = links.begin(); i != links.end(); ++i)
+        if (std::find(found.begin(), found.end(), i->first) == found.end())
+            gone.push_back(i->first);
+
+    for (size_t i = 0; i < gone.size(); i++)
+        leave(gone[i], links);
+
+    if (dispatch::cells->cells().empty())
+        return;
+
+    std::vector<jobs::job> held;
+    held.swap(dispatch::waiting);
+    for (size_t i = 0; i < held.size(); i++)
+        give(held[i]);
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, dispatch::nodeName);
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    int lookahead;
+    double discoverPeriod, statusPeriod;
+
+    pnh.param("lookahead", lookahead, 2); // jobs a cell is sent ahead, the rest can still be moved
+    pnh.param("discover_period", discoverPeriod, 5.0); // seconds between looking for cells
+    pnh.param("status_period", statusPeriod, 30.0); // seconds between logging the cells
+
+    fleet::dispatcher cells(lookahead);
+    dispatch::cells = &cells;
+
+    // relative names so the dispatcher takes the same jobs topic as a single job controller
+    dispatch::progress = nh.advertise<std_msgs::Int32MultiArray>("jobProgress", 10);
+    dispatch::finished = nh.advertise<std_msgs::Int32>("jobDone", 100);
+    ros::Subscriber sub = nh.subscribe("jobs", 1000, jobCallback);
+
+    std::map<std::string, channel> links;
+    std::vector<std::pair<size_t, jobs::job> > released;
+    double lastDiscover = 0;
+    double lastStatus = ros::Time::now().toSec();
+
+    while (ros::ok())
+    {
+        ros::spinOnce();
+        double now = ros::Time::now().toSec();
+
+        if (now - lastDiscover >= discoverPeriod)
+        {
+            update(nh, links);
+            lastDiscover = now;
+        }
+
+        // a cell is only sent jobs once its job controller is listening
+        for (std::map<std::string, channel>::iterator i = links.begin(); i != links.end(); ++i)
+            cells.connect(i->first, i->second.jobs.getNumSubscribers() > 0);
+
+        int stolen = cells.steal(now);
+        if (stolen > 0)
+            ROS_INFO("Moved %d jobs to cells which were running out of work.", stolen);
+
+        cells.release(now, released);
+        for (size_t i = 0; i < released.size(); i++)
+        {
+            const jobs::job &j = released[i].second;
+            std_msgs::Float32MultiArray jobMsg;
+            float fields[] = { (float)j.id, j.pick.x, j.pick.y, j.pick.z, j.place.x, j.place.y, j.place.z, j.grip };
+
+            jobMsg.data.assign(fields, fields + dispatch::jobFields);
+            links[cells.cells()[released[i].first].ns].jobs.publish(jobMsg);
+        }
+
+        if (now - lastStatus >= statusPeriod)
+        {
+            for (size_t i = 0; i < cells.cells().size(); i++)
+            {
+                const fleet::cell &c = cells.cells()[i];
+
+                ROS_INFO("%s: %zu queued, %d done, finishing in %.0f s, %.2f times the profile time.", c.ns.c_str(),
+                         c.backlog.size() + c.released.size(), c.done, cells.finish(c, now) - now, c.slowdown);
+            }
+            lastStatus = now;
+        }
+
+        ros::Duration(0.1).sleep();
+    }
+}
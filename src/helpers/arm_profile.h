@@ -0,0 +1,130 @@
+#ifndef ARM_PROFILE_H
+#define ARM_PROFILE_H
+
+#include "config.h"
+
+#include <string>
+
+// The per arm data used by the controllers.
+// Every arm is compiled in as a type with a constexpr table, code which is templated on the arm type
+// sees the table as constants while the arm itself is picked at startup with withArm().
+namespace arms
+{
+    const int maxJoints = 7;
+
+    struct jointLimit
+    {
+        float min, max;     // rad
+        float velocity;     // rad/s
+        float acceleration; // rad/s^2
+    };
+
+    struct profile
+    {
+        const char *name;
+        const char *ns; // the namespace of the arm's nodes
+
+        int numJoints;
+        jointLimit joints[maxJoints]; // base, shoulder, elbow, pitch, roll, ...
+
+        // reach, the arm is modelled as a base rotation and a planar shoulder, elbow and wrist
+        float shoulderHeight; // height of the shoulder joint above the table
+        float shoulderOffset; // horizontal offset of the shoulder joint from the base axis
+        float upperArm;       // shoulder to elbow
+        float forearm;        // elbow to wrist
+        float tool;           // wrist to the grip point
+        float maxReach;       // horizontal distance from the base axis
+        float minHeight, maxHeight;
+
+        // grip range (m)
+        float minGrip, maxGrip;
+
+        // wait times (if running on a vm these may need to be increased.)
+        int gripWait; // time for the gripper to open and close.
+        int rotWait;  // time for the gripper to rotate an eighth of a turn
+        int liftWait; // time for the gripper to raise and lower
+    };
+
+    struct scorbot
+    {
+        static constexpr profile table()
+        {
+            return {
+                "scorbot", "/scorbot",
+                5,
+                {
+                    { -2.705, 2.705, 1.38, 2.0 },  // base
+                    { -0.611, 2.269, 1.19, 2.0 },  // shoulder
+                    { -2.269, 2.269, 1.33, 2.0 },  // elbow
+                    { -2.269, 2.269, 1.52, 3.0 },  // pitch
+                    { -9.948, 9.948, 2.90, 4.0 },  // roll
+                },
+                0.3585, 0.050, 0.300, 0.350, 0.145,
+                0.610, 0.000, 0.800,
+                0.000, 0.075,
+                10, 9, 5
+            };
+        }
+    };
+
+    // The andreas arm has no measured timings yet so it starts from the scorbot waits.
+    // The joint limits are measured, the wrist (delta) only turns a quarter turn each way so the arm
+    // can not hold the gripper pointing down much above 0.15 m at the pegs.
+    struct andreasArm
+    {
+        static constexpr profile table()
+        {
+            return {
+                "andreas_arm", "/andreas_arm",
+                6,
+                {
+                    { -1.571, 1.571, 1.5, 3.0 },   // alpha
+                    { -1.571, 1.571, 1.5, 3.0 },   // beta
+                    { -1.571, 1.571, 1.5, 3.0 },   // gamma
+                    { -1.571, 1.571, 1.5, 3.0 },   // delta
+                    { -1.571, 1.571, 2.0, 4.0 },   // epsilon
+                    { -1.571, 1.571, 2.0, 4.0 },   // zeta
+                },
+                0.100, 0.000, 0.200, 0.200, 0.080,
+                0.400, 0.000, 0.450,
+                0.000, 0.070,
+                10, 9, 5
+            };
+        }
+    };
+
+#ifdef ANDREAS_ARM
+    typedef andreasArm defaultArm;
+#else
+    typedef scorbot defaultArm;
+#endif
+
+    // Calls f with an instance of every arm type, new arms only have to be added here.
+    template <class F>
+    void forEachArm(F f)
+    {
+        f(scorbot());
+        f(andreasArm());
+    }
+
+    // Calls f with an instance of the arm type with the name, false if there is no such arm.
+    // f is usually a generic lambda which forwards to a function templated on the arm type.
+    template <class F>
+    bool withArm(const std::string &name, F f)
+    {
+        bool found = false;
+
+        forEachArm([&](auto arm)
+        {
+            if (!found && name == decltype(arm)::table().name)
+            {
+                f(arm);
+                found = true;
+            }
+        });
+
+        return found;
+    }
+}
+
+#endif // ARM_PROFILE_H
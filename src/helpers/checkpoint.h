@@ -0,0 +1,271 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "hanoi.h"
+#include "plan_search.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// An append only log of the world model and plan position.
+// A begin record is written before a move is started and a commit record once it is done,
+// so a restarted controller can tell if it was stopped part way through a move.
+// Every record also holds the options of the plan its index is into, so the same plan can be built again.
+class checkpoint
+{
+    public:
+        enum kind
+        {
+            beginMove = 1,
+            commitMove = 2
+        };
+
+        struct record
+        {
+            uint32_t magic;
+            uint32_t seq;
+            uint32_t planIndex; // the move being started or the next move once committed
+            uint8_t kind;
+            uint8_t numBlocks;
+            uint8_t pegs[hanoi::maxBlocks];
+            search::options plan; // the plan planIndex is into
+            uint16_t check;
+        };
+
+        // Opens (or creates) the checkpoint file.
+        // Files larger than maxSize, or with a torn record in them, are compacted down to their last
+        // record before anything is appended. A file which does not start with a record is not a
+        // checkpoint (or one from an older version), it is moved aside to <path>.old instead of being wiped.
+        checkpoint(const std::string &path, size_t maxSize = 64 * 1024) :
+            path(path),
+            fd(-1),
+            seq(0),
+            plan()
+        {
+            record last;
+            bool found = readLast(last);
+
+            if (found)
+                seq = last.seq + 1;
+
+            size_t size = fileSize();
+
+            // appending after a torn record would put every new record off the record boundaries
+            if (found && (size > maxSize || size % sizeof(record) != 0))
+                compact(last);
+            else if (!found && size > 0 && !startsWithRecord())
+            {
+                std::string old = path + ".old";
+
+                if (std::rename(path.c_str(), old.c_str()) != 0)
+                {
+                    problem = "it is not a checkpoint and could not be moved to " + old + ": " + std::strerror(errno);
+                    return;
+                }
+                problem = "it was not a checkpoint, it was moved to " + old;
+            }
+            else if (!found && size > 0)
+            {
+                if (::truncate(path.c_str(), 0) != 0)
+                {
+                    problem = std::string("it has no complete record and could not be cleared: ") + std::strerror(errno);
+                    return;
+                }
+                problem = "it had no complete record and was cleared";
+            }
+
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0)
+                problem = std::strerror(errno);
+        }
+
+        ~checkpoint()
+        {
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        bool isOpen() const
+        {
+            return fd >= 0;
+        }
+
+        // What went wrong opening the file, or what was done about it, empty if nothing.
+        const std::string &notice() const
+        {
+            return problem;
+        }
+
+        // Reads the last complete record, false if there is none.
+        bool load(record &out) const
+        {
+            return readLast(out);
+        }
+
+        // Restores the world model from a record.
+        static hanoi::world restore(const record &r)
+        {
+            hanoi::world w(r.numBlocks);
+
+            for (int i = 0; i < r.numBlocks && i < hanoi::maxBlocks; i++)
+                w.place(i, r.pegs[i]);
+
+            return w;
+        }
+
+        // Sets the plan written with the records from now on.
+        void use(const search::options &opt)
+        {
+            plan = opt;
+        }
+
+        bool begin(uint32_t planIndex, const hanoi::world &w)
+        {
+            return append(beginMove, planIndex, w);
+        }
+
+        bool commit(uint32_t planIndex, const hanoi::world &w)
+        {
+            return append(commitMove, planIndex, w);
+        }
+
+    private:
+        static const uint32_t recordMagic = 0x4c434153; // "SACL", records before the plan was kept were "SACK"
+
+        static uint16_t checksum(const record &r)
+        {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&r);
+            uint16_t sum = 0;
+
+            for (size_t i = 0; i < offsetof(record, check); i++)
+                sum = (uint16_t)((sum << 1 | sum >> 15) ^ bytes[i]);
+
+            return sum;
+        }
+
+        static bool valid(const record &r)
+        {
+            return r.magic == recordMagic && r.numBlocks <= hanoi::maxBlocks && r.check == checksum(r);
+        }
+
+        bool append(kind k, uint32_t planIndex, const hanoi::world &w)
+        {
+            record r;
+
+            std::memset(&r, 0, sizeof(r));
+            r.magic = recordMagic;
+            r.seq = seq++;
+            r.planIndex = planIndex;
+            r.kind = k;
+            r.numBlocks = w.blocks();
+            for (int i = 0; i < w.blocks(); i++)
+                r.pegs[i] = w.pegOf(i);
+            r.plan = plan;
+            r.check = checksum(r);
+
+            if (fd < 0 || ::write(fd, &r, sizeof(r)) != sizeof(r))
+                return false;
+
+            // the record must be on disk before the arm moves on
+            return ::fdatasync(fd) == 0;
+        }
+
+        bool readLast(record &out) const
+        {
+            FILE *file = std::fopen(path.c_str(), "rb");
+            std::vector<uint8_t> data;
+            uint8_t buffer[4096];
+            size_t n;
+            bool found = false;
+
+            if (!file)
+                return false;
+
+            while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+                data.insert(data.end(), buffer, buffer + n);
+            std::fclose(file);
+
+            // a torn record is skipped a byte at a time until the records line up again
+            for (size_t i = 0; i + sizeof(record) <= data.size();)
+            {
+                record r;
+
+                std::memcpy(&r, &data[i], sizeof(r));
+                if (!valid(r))
+                {
+                    i++;
+                    continue;
+                }
+
+                out = r;
+                found = true;
+                i += sizeof(r);
+            }
+
+            return found;
+        }
+
+        // True if the file starts with the magic of a record, even a torn one.
+        bool startsWithRecord() const
+        {
+            FILE *file = std::fopen(path.c_str(), "rb");
+            uint32_t first = 0;
+            bool ok = false;
+
+            if (file)
+            {
+                ok = std::fread(&first, sizeof(first), 1, file) == 1 && first == recordMagic;
+                std::fclose(file);
+            }
+
+            return ok;
+        }
+
+        size_t fileSize() const
+        {
+            FILE *file = std::fopen(path.c_str(), "rb");
+            long size = 0;
+
+            if (file)
+            {
+                std::fseek(file, 0, SEEK_END);
+                size = std::ftell(file);
+                std::fclose(file);
+            }
+
+            return size < 0 ? 0 : size;
+        }
+
+        // Replaces the file with one holding only the last record.
+        void compact(const record &last)
+        {
+            std::string temp = path + ".tmp";
+            int tempFd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+            if (tempFd < 0)
+                return;
+
+            bool written = ::write(tempFd, &last, sizeof(last)) == sizeof(last) && ::fsync(tempFd) == 0;
+
+            ::close(tempFd);
+            if (written)
+                std::rename(temp.c_str(), path.c_str());
+            else
+                std::remove(temp.c_str());
+        }
+
+        std::string path;
+        int fd;
+        uint32_t seq;
+        search::options plan;
+        std::string problem;
+};
+
+#endif // CHECKPOINT_H
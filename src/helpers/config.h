@@ -4,6 +4,6 @@
 // Debug
 #define DEBUG
 
-// arm
+// arm (the default arm profile when the ~arm param is not set, see arm_profile.h)
 //#define ANDREAS_ARM
 #define SCORBOT
@@ -0,0 +1,353 @@
+#ifndef COOPERATIVE_H
+#define COOPERATIVE_H
+
+#include "hanoi.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Scheduling for several arms sharing one set of pegs.
+// Every peg is a zone, an arm holds the zone of a peg while it works on it and while its transits
+// pass over it. Moves are given to the arm which finishes them first and placed in a reservation
+// table so no two arms are ever in the same zone.
+namespace coop
+{
+    enum phase
+    {
+        approach, // from the park position to over the block
+        pick,     // lower, grip and lift the block
+        carry,    // over to the other peg
+        place,    // lower, release and lift
+        retreat   // back to the park position
+    };
+
+    const int numPhases = 5;
+
+    // Where an arm's base stands in the cell's frame, yaw turns the arm's x axis from the cell's.
+    struct base
+    {
+        float x, y, yaw;
+    };
+
+    // A point in the cell's frame as the arm on the base sees it.
+    inline hanoi::point toArm(const base &b, hanoi::point p)
+    {
+        float dx = p.x - b.x;
+        float dy = p.y - b.y;
+
+        return { dx * std::cos(b.yaw) + dy * std::sin(b.yaw), -dx * std::sin(b.yaw) + dy * std::cos(b.yaw) };
+    }
+
+    // One arm's view of the cell.
+    struct armCell
+    {
+        hanoi::layout layout; // the pegs in the arm's frame
+        hanoi::point park;    // where the arm waits clear of the pegs
+        float gripTime;       // seconds to open or close the gripper
+        float liftTime;       // seconds to raise or lower
+        float rotTime;        // seconds to rotate an eighth of a turn
+    };
+
+    // A scheduled phase of a move.
+    struct step
+    {
+        int move; // index in the plan
+        phase kind;
+        double start, end;
+        unsigned zones; // bit mask of the pegs held
+        int tickets[hanoi::numPegs]; // the turn of this step in each zone it holds
+        std::vector<hanoi::waypoint> path;
+    };
+
+    struct schedule
+    {
+        std::vector<std::vector<step> > arms;
+        std::vector<int> assigned; // the arm for each move
+        double makespan;
+    };
+
+    // The time each zone is held for.
+    class reservations
+    {
+        public:
+            reservations(double clearance) :
+                clearance(clearance)
+            {
+            }
+
+            bool isFree(unsigned zones, double start, double end) const
+            {
+                for (int z = 0; z < hanoi::numPegs; z++)
+                {
+                    if (!(zones & (1u << z)))
+                        continue;
+
+                    for (size_t i = 0; i < held[z].size(); i++)
+                        if (start < held[z][i].second + clearance && held[z][i].first < end + clearance)
+                            return false;
+                }
+
+                return true;
+            }
+
+            void reserve(unsigned zones, double start, double end)
+            {
+                for (int z = 0; z < hanoi::numPegs; z++)
+                    if (zones & (1u << z))
+                        held[z].push_back(std::make_pair(start, end));
+            }
+
+            // The ends of every reservation in the zones, where a later step could start.
+            void ends(unsigned zones, std::vector<double> &out) const
+            {
+                for (int z = 0; z < hanoi::numPegs; z++)
+                    if (zones & (1u << z))
+                        for (size_t i = 0; i < held[z].size(); i++)
+                            out.push_back(held[z][i].second + clearance);
+            }
+
+        private:
+            double clearance; // time between one arm leaving a zone and another entering it
+            std::vector<std::pair<double, double> > held[hanoi::numPegs];
+    };
+
+    inline float turnTime(const armCell &c, hanoi::point from, hanoi::point to)
+    {
+        float turn = std::fabs(hanoi::heading(to.x, to.y) - hanoi::heading(from.x, from.y));
+
+        return c.rotTime * turn / (M_PI / 4);
+    }
+
+    // The pegs passed over when turning from one point to another.
+    inline unsigned swept(const armCell &c, hanoi::point from, hanoi::point to)
+    {
+        float a = hanoi::heading(from.x, from.y);
+        float b = hanoi::heading(to.x, to.y);
+        unsigned zones = 0;
+
+        for (int p = 0; p < hanoi::numPegs; p++)
+        {
+            float h = hanoi::heading(c.layout.pegs[p].x, c.layout.pegs[p].y);
+
+            if (h >= std::min(a, b) - 1e-3 && h <= std::max(a, b) + 1e-3)
+                zones |= 1u << p;
+        }
+
+        return zones;
+    }
+
+    // Builds the phases of a move for an arm, start times are relative to the start of the move.
+    inline void phases(const armCell &c, const hanoi::world &w, hanoi::move m, int index, std::vector<step> &out)
+    {
+        std::vector<hanoi::waypoint> path;
+        hanoi::point from = c.layout.pegs[m.from];
+        hanoi::point to = c.layout.pegs[m.to];
+        double work = 2 * c.liftTime + c.gripTime;
+
+        hanoi::expand(w, m, c.layout, path);
+
+        step s[numPhases];
+        s[approach].zones = swept(c, c.park, from);
+        s[approach].end = turnTime(c, c.park, from);
+        s[approach].path.assign(path.begin(), path.begin() + 1);
+        s[pick].zones = 1u << m.from;
+        s[pick].end = work;
+        s[pick].path.assign(path.begin() + 1, path.begin() + 4);
+        s[carry].zones = swept(c, from, to);
+        s[carry].end = turnTime(c, from, to);
+        s[carry].path.assign(path.begin() + 4, path.begin() + 5);
+        s[place].zones = 1u << m.to;
+        s[place].end = work;
+        s[place].path.assign(path.begin() + 5, path.end());
+        s[retreat].zones = swept(c, to, c.park);
+        s[retreat].end = turnTime(c, to, c.park);
+        s[retreat].path.push_back({ c.park.x, c.park.y, c.layout.raised, c.layout.roll, c.layout.pitch,
+                                    c.layout.openGrip, hanoi::rotateSegment, -1 });
+
+        double t = 0;
+        for (int i = 0; i < numPhases; i++)
+        {
+            s[i].move = index;
+            s[i].kind = (phase)i;
+            for (int z = 0; z < hanoi::numPegs; z++)
+                s[i].tickets[z] = -1;
+            s[i].start = t;
+            s[i].end += t;
+            t = s[i].end;
+            out.push_back(s[i]);
+        }
+    }
+
+    // Shifts the phases of a move to the earliest start after ready which fits in the reservations.
+    inline double fit(const reservations &table, std::vector<step> &chain, double ready)
+    {
+        std::vector<double> candidates(1, ready);
+
+        for (size_t i = 0; i < chain.size(); i++)
+        {
+            std::vector<double> ends;
+
+            table.ends(chain[i].zones, ends);
+            for (size_t j = 0; j < ends.size(); j++)
+                if (ends[j] - chain[i].start > ready)
+                    candidates.push_back(ends[j] - chain[i].start);
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            bool free = true;
+
+            for (size_t j = 0; j < chain.size() && free; j++)
+                free = table.isFree(chain[j].zones, candidates[i] + chain[j].start, candidates[i] + chain[j].end);
+
+            if (free)
+                return candidates[i];
+        }
+
+        // the last reservation always ends before one of the candidates
+        return candidates.back();
+    }
+
+    // Gives every move of the plan to an arm.
+    // Moves are taken in plan order and each peg is handed over in plan order, so every block is
+    // placed before it is picked up again.
+    inline schedule plan(const std::vector<hanoi::move> &moves, hanoi::world w,
+                         const std::vector<armCell> &cells, double clearance = 1.0)
+    {
+        schedule result;
+        reservations table(clearance);
+        std::vector<double> armFree(cells.size(), 0);
+        double pegDone[hanoi::numPegs] = { 0 }; // when the last pick or place on each peg ends
+
+        result.arms.resize(cells.size());
+        result.makespan = 0;
+
+        for (size_t m = 0; m < moves.size(); m++)
+        {
+            int best = -1;
+            double bestStart = 0;
+            std::vector<step> bestChain;
+
+            for (size_t a = 0; a < cells.size(); a++)
+            {
+                std::vector<step> chain;
+
+                phases(cells[a], w, moves[m], m, chain);
+                double ready = std::max(armFree[a], std::max(pegDone[moves[m].from] - chain[pick].start,
+                                                             pegDone[moves[m].to] - chain[place].start));
+                double start = fit(table, chain, ready);
+
+                if (best < 0 || start + chain[place].end < bestStart + bestChain[place].end)
+                {
+                    best = a;
+                    bestStart = start;
+                    bestChain.swap(chain);
+                }
+            }
+
+            for (size_t i = 0; i < bestChain.size(); i++)
+            {
+                bestChain[i].start += bestStart;
+                bestChain[i].end += bestStart;
+                table.reserve(bestChain[i].zones, bestChain[i].start, bestChain[i].end);
+                result.arms[best].push_back(bestChain[i]);
+            }
+
+            armFree[best] = bestChain.back().end;
+            pegDone[moves[m].from] = bestChain[pick].end;
+            pegDone[moves[m].to] = bestChain[place].end;
+            result.assigned.push_back(best);
+            result.makespan = std::max(result.makespan, armFree[best]);
+            w.apply(moves[m]);
+        }
+
+        // hand out the turns in each zone in time order
+        for (int z = 0; z < hanoi::numPegs; z++)
+        {
+            std::vector<std::pair<double, step *> > users;
+
+            for (size_t a = 0; a < result.arms.size(); a++)
+                for (size_t i = 0; i < result.arms[a].size(); i++)
+                    if (result.arms[a][i].zones & (1u << z))
+                        users.push_back(std::make_pair(result.arms[a][i].start, &result.arms[a][i]));
+
+            std::stable_sort(users.begin(), users.end(),
+                             [](const std::pair<double, step *> &l, const std::pair<double, step *> &r)
+                             {
+                                 return l.first < r.first;
+                             });
+
+            for (size_t i = 0; i < users.size(); i++)
+                users[i].second->tickets[z] = i;
+        }
+
+        return result;
+    }
+
+    // Makes the arms take their turns in each zone in the scheduled order while they run.
+    // An arm takes the zones of its next step before it lets go of the current ones, the clearance
+    // between arms in the schedule means two arms can never be waiting on each other.
+    class zoneTurns
+    {
+        public:
+            zoneTurns() :
+                stopped(false)
+            {
+                for (int z = 0; z < hanoi::numPegs; z++)
+                    turn[z] = 0;
+            }
+
+            // Moves from holding the zones of one step (or none) to those of the next (or none).
+            // Returns false if the turns were stopped while waiting.
+            bool handOver(const step *current, const step *next)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                unsigned held = current ? current->zones : 0;
+
+                if (next)
+                {
+                    wake.wait(lock, [&]()
+                    {
+                        if (stopped)
+                            return true;
+
+                        for (int z = 0; z < hanoi::numPegs; z++)
+                            if ((next->zones & ~held & (1u << z)) && turn[z] != next->tickets[z])
+                                return false;
+
+                        return true;
+                    });
+                }
+
+                for (int z = 0; z < hanoi::numPegs; z++)
+                    if (held & (1u << z))
+                        turn[z]++;
+
+                wake.notify_all();
+                return !stopped;
+            }
+
+            // Wakes every arm which is waiting, used when shutting down.
+            void stop()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                stopped = true;
+                wake.notify_all();
+            }
+
+        private:
+            std::mutex mutex;
+            std::condition_variable wake;
+            int turn[hanoi::numPegs];
+            bool stopped;
+    };
+}
+
+#endif // COOPERATIVE_H
@@ -0,0 +1,318 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "arm_profile.h"
+#include "hanoi.h"
+#include "job_queue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Shares pick and place jobs between cells, each cell is an arm running its own job controller.
+// A job goes to the cell predicted to finish it first. Cells are only sent a few jobs ahead, the
+// rest wait here so a cell which runs dry can take jobs from the end of a cell which has fallen behind.
+namespace fleet
+{
+    const float learnRate = 0.3;  // how quickly the speed of a cell is learned from finished jobs
+    const float minRatio = 0.25;  // a single job only counts as this much faster or slower than its profile time
+    const float maxRatio = 4.0;
+
+    // The profile wait time for a job starting from a location, the same waits the job controller uses.
+    inline float jobTime(const arms::profile &p, const jobs::location &from, const jobs::job &j)
+    {
+        float approach = std::fabs(hanoi::heading(j.pick.x, j.pick.y) - hanoi::heading(from.x, from.y));
+        float carry = std::fabs(hanoi::heading(j.place.x, j.place.y) - hanoi::heading(j.pick.x, j.pick.y));
+
+        return p.rotWait * (approach + carry) / (M_PI / 4) + 2 * p.gripWait + 4 * p.liftWait;
+    }
+
+    struct cell
+    {
+        std::string ns;
+        arms::profile arm;
+        bool (*reachable)(const jobs::job &j); // checks a job against the arm
+
+        std::deque<jobs::job> backlog;   // given to the cell but not sent yet
+        std::vector<jobs::job> released; // sent to the cell and not finished yet
+        jobs::location origin;           // where the arm started the job it is running
+        double started;                  // when it started it, s
+        float slowdown;                  // learned time taken over the profile time
+        int done;
+        bool connected;                  // the cell's job controller is listening
+    };
+
+    inline cell makeCell(const std::string &ns, const arms::profile &arm, bool (*reachable)(const jobs::job &j),
+                         const jobs::location &home)
+    {
+        cell c;
+
+        c.ns = ns;
+        c.arm = arm;
+        c.reachable = reachable;
+        c.origin = home;
+        c.started = 0;
+        c.slowdown = 1;
+        c.done = 0;
+        c.connected = false;
+
+        return c;
+    }
+
+    class dispatcher
+    {
+        public:
+            // lookahead is how many jobs each cell is sent before it finishes one.
+            dispatcher(size_t lookahead) :
+                lookahead(std::max((size_t)1, lookahead))
+            {
+            }
+
+            const std::vector<cell> &cells() const
+            {
+                return members;
+            }
+
+            int find(const std::string &ns) const
+            {
+                for (size_t i = 0; i < members.size(); i++)
+                    if (members[i].ns == ns)
+                        return i;
+
+                return -1;
+            }
+
+            void add(const cell &c)
+            {
+                members.push_back(c);
+            }
+
+            void connect(const std::string &ns, bool connected)
+            {
+                int i = find(ns);
+
+                if (i >= 0)
+                    members[i].connected = connected;
+            }
+
+            // Drops a cell and returns the jobs it had not finished so they can be given out again.
+            std::vector<jobs::job> remove(const std::string &ns)
+            {
+                std::vector<jobs::job> orphans;
+                int i = find(ns);
+
+                if (i < 0)
+                    return orphans;
+
+                orphans = members[i].released;
+                orphans.insert(orphans.end(), members[i].backlog.begin(), members[i].backlog.end());
+                members.erase(members.begin() + i);
+
+                return orphans;
+            }
+
+            // How many times slower than learned a cell is running its current job, at least 1.
+            float lag(const cell &c, double now) const
+            {
+                if (c.released.empty())
+                    return 1;
+
+                float expected = jobTime(c.arm, c.origin, c.released.front()) * c.slowdown;
+
+                return expected > 0 ? std::max(1.0, (now - c.started) / expected) : 1;
+            }
+
+            // Where the arm ends up once it has run the jobs it has been given.
+            jobs::location last(const cell &c) const
+            {
+                if (!c.backlog.empty())
+                    return c.backlog.back().place;
+                if (!c.released.empty())
+                    return c.released.back().place;
+
+                return c.origin;
+            }
+
+            // The predicted time a cell finishes every job it has been given.
+            double finish(const cell &c, double now) const
+            {
+                float slow = c.slowdown * lag(c, now);
+                jobs::location at = c.origin;
+                double work = 0;
+
+                for (size_t i = 0; i < c.released.size(); i++)
+                {
+                    work += jobTime(c.arm, at, c.released[i]) * slow;
+                    at = c.released[i].place;
+                }
+
+                work = c.released.empty() ? 0 : std::max(0.0, work - (now - c.started));
+
+                for (size_t i = 0; i < c.backlog.size(); i++)
+                {
+                    work += jobTime(c.arm, at, c.backlog[i]) * slow;
+                    at = c.backlog[i].place;
+                }
+
+                return now + work;
+            }
+
+            // The predicted time a cell would finish a job added to the end of its work.
+            double finishWith(const cell &c, const jobs::job &j, double now) const
+            {
+                return finish(c, now) + jobTime(c.arm, last(c), j) * c.slowdown * lag(c, now);
+            }
+
+            // Gives a job to the cell which will finish it first, -1 if no cell can reach it.
+            int assign(const jobs::job &j, double now)
+            {
+                int best = -1;
+                double bestTime = 0;
+
+                for (size_t i = 0; i < members.size(); i++)
+                {
+                    if (!members[i].reachable(j))
+                        continue;
+
+                    double t = finishWith(members[i], j, now);
+
+                    if (best < 0 || t < bestTime)
+                    {
+                        best = i;
+                        bestTime = t;
+                    }
+                }
+
+                if (best >= 0)
+                    members[best].backlog.push_back(j);
+
+                return best;
+            }
+
+            // Records a finished job and learns how fast the cell is, false if the job was not sent to it.
+            bool finished(const std::string &ns, uint32_t id, double now)
+            {
+                int i = find(ns);
+
+                if (i < 0)
+                    return false;
+
+                cell &c = members[i];
+
+                for (size_t k = 0; k < c.released.size(); k++)
+                {
+                    if (c.released[k].id != id)
+                        continue;
+
+                    // the job controller may have reordered the jobs, time it from where the arm was
+                    float expected = jobTime(c.arm, c.origin, c.released[k]);
+                    if (expected > 0)
+                    {
+                        float ratio = std::min(maxRatio, std::max(minRatio, (float)((now - c.started) / expected)));
+                        c.slowdown += learnRate * (ratio - c.slowdown);
+                    }
+
+                    c.origin = c.released[k].place;
+                    c.started = now;
+                    c.released.erase(c.released.begin() + k);
+                    c.done++;
+
+                    return true;
+                }
+
+                return false;
+            }
+
+            // Moves jobs from the backlogs up to the lookahead of each connected cell, out gets the cell
+            // and job of each.
+            void release(double now, std::vector<std::pair<size_t, jobs::job> > &out)
+            {
+                out.clear();
+
+                for (size_t i = 0; i < members.size(); i++)
+                {
+                    cell &c = members[i];
+
+                    while (c.connected && !c.backlog.empty() && c.released.size() < lookahead)
+                    {
+                        // an idle cell starts on the job now
+                        if (c.released.empty())
+                            c.started = now;
+
+                        c.released.push_back(c.backlog.front());
+                        c.backlog.pop_front();
+                        out.push_back(std::make_pair(i, c.released.back()));
+                    }
+                }
+            }
+
+            // Cells which are running out of work take jobs from the end of the cell predicted to finish
+            // last, as long as they would finish them sooner. Returns how many jobs were moved.
+            int steal(double now)
+            {
+                int moved = 0;
+
+                while (true)
+                {
+                    int thief = -1;
+                    int victim = -1;
+
+                    for (size_t i = 0; i < members.size(); i++)
+                    {
+                        const cell &c = members[i];
+
+                        if (c.backlog.empty() && c.released.size() < lookahead &&
+                            (thief < 0 || finish(c, now) < finish(members[thief], now)))
+                            thief = i;
+
+                        if (!c.backlog.empty() && (victim < 0 || finish(c, now) > finish(members[victim], now)))
+                            victim = i;
+                    }
+
+                    if (thief < 0 || victim < 0 || thief == victim)
+                        return moved;
+
+                    cell &from = members[victim];
+                    cell &to = members[thief];
+                    double victimFinish = finish(from, now);
+                    bool taken = false;
+
+                    // the last jobs are the ones the victim would finish latest
+                    for (size_t k = from.backlog.size(); k-- > 0 && !taken;)
+                    {
+                        const jobs::job &j = from.backlog[k];
+
+                        if (!to.reachable(j) || finishWith(to, j, now) >= victimFinish)
+                            continue;
+
+                        to.backlog.push_back(j);
+                        from.backlog.erase(from.backlog.begin() + k);
+                        taken = true;
+                    }
+
+                    if (!taken)
+                        return moved;
+
+                    moved++;
+                }
+            }
+
+            size_t queued() const
+            {
+                size_t total = 0;
+
+                for (size_t i = 0; i < members.size(); i++)
+                    total += members[i].backlog.size() + members[i].released.size();
+
+                return total;
+            }
+
+        private:
+            size_t lookahead;
+            std::vector<cell> members;
+    };
+}
+
+#endif // FLEET_H
@@ -0,0 +1,190 @@
+#ifndef HANOI_H
+#define HANOI_H
+
+#include <cmath>
+#include <vector>
+
+namespace hanoi
+{
+    const int numPegs = 3;
+    const int maxBlocks = 8;
+
+    // A transfer of the top block of one peg onto another peg.
+    struct move
+    {
+        int from;
+        int to;
+    };
+
+    // The world model, which peg every block sits on.
+    // Block 0 is the largest so the blocks on a peg are always stacked in index order.
+    class world
+    {
+        public:
+            // All of the blocks start stacked on one peg.
+            world(int numBlocks = 3, int peg = 0) :
+                numBlocks(numBlocks)
+            {
+                for (int i = 0; i < maxBlocks; i++)
+                    pegs[i] = peg;
+            }
+
+            int blocks() const
+            {
+                return numBlocks;
+            }
+
+            int pegOf(int block) const
+            {
+                return pegs[block];
+            }
+
+            void place(int block, int peg)
+            {
+                pegs[block] = peg;
+            }
+
+            // The block on the top of the peg or -1 if the peg is empty.
+            int top(int peg) const
+            {
+                for (int i = numBlocks - 1; i >= 0; i--)
+                    if (pegs[i] == peg)
+                        return i;
+
+                return -1;
+            }
+
+            // The combined height of the blocks on the peg which are larger than the block.
+            float heightBelow(int peg, int block, const float *blockHeight) const
+            {
+                float height = 0;
+
+                for (int i = 0; i < block && i < numBlocks; i++)
+                    if (pegs[i] == peg)
+                        height += blockHeight[i];
+
+                return height;
+            }
+
+            bool canMove(move m) const
+            {
+                if (m.from == m.to || m.from < 0 || m.from >= numPegs || m.to < 0 || m.to >= numPegs)
+                    return false;
+
+                int block = top(m.from);
+
+                return block >= 0 && top(m.to) < block;
+            }
+
+            // Moves the top block and returns which block was moved.
+            int apply(move m)
+            {
+                int block = top(m.from);
+
+                pegs[block] = m.to;
+                return block;
+            }
+
+            bool operator==(const world &other) const
+            {
+                if (numBlocks != other.numBlocks)
+                    return false;
+
+                for (int i = 0; i < numBlocks; i++)
+                    if (pegs[i] != other.pegs[i])
+                        return false;
+
+                return true;
+            }
+
+        private:
+            int numBlocks;
+            int pegs[maxBlocks];
+    };
+
+    // Appends the moves which take a stack of n blocks from one peg to another.
+    inline void solve(int n, int from, int to, std::vector<move> &plan)
+    {
+        if (n <= 0)
+            return;
+
+        int via = numPegs - from - to;
+
+        solve(n - 1, from, via, plan);
+        plan.push_back({ from, to });
+        solve(n - 1, via, to, plan);
+    }
+
+    // The kind of motion a waypoint ends, used to decide how long to wait for it.
+    enum segment
+    {
+        rotateSegment,
+        lowerSegment,
+        gripSegment,
+        raiseSegment
+    };
+
+    struct waypoint
+    {
+        float x, y, z;
+        float roll, pitch;
+        float hand;
+        segment kind;
+        int block; // the block in the gripper, -1 when it is empty or not known
+    };
+
+    struct point
+    {
+        float x, y;
+    };
+
+    // Where the pegs are and the sizes of the blocks.
+    struct layout
+    {
+        point pegs[numPegs];
+        float blockHeight[maxBlocks];
+        float blockGrip[maxBlocks];
+        float openGrip;
+        float raised; // transit height
+        float lift;   // height above the blocks below to grip at
+        float drop;   // height above the blocks below to release at
+        float roll;
+        float pitch;
+    };
+
+    // The base rotation to reach a point.
+    inline float heading(float x, float y)
+    {
+        return std::atan2(y, x);
+    }
+
+    // Appends the waypoints to carry out a move in the world (the world is not changed).
+    inline void expand(const world &w, move m, const layout &l, std::vector<waypoint> &out)
+    {
+        int block = w.top(m.from);
+        float grip = l.blockGrip[block];
+        point from = l.pegs[m.from];
+        point to = l.pegs[m.to];
+        float pick = w.heightBelow(m.from, block, l.blockHeight) + l.lift;
+        float place = w.heightBelow(m.to, block, l.blockHeight) + l.drop;
+
+        // turn to move over the block
+        out.push_back({ from.x, from.y, l.raised, l.roll, l.pitch, l.openGrip, rotateSegment, -1 });
+        // lower onto the block
+        out.push_back({ from.x, from.y, pick, l.roll, l.pitch, l.openGrip, lowerSegment, -1 });
+        // close the hand on the block
+        out.push_back({ from.x, from.y, pick, l.roll, l.pitch, grip, gripSegment, block });
+        // lift up the block
+        out.push_back({ from.x, from.y, l.raised, l.roll, l.pitch, grip, raiseSegment, block });
+        // move the block over the peg
+        out.push_back({ to.x, to.y, l.raised, l.roll, l.pitch, grip, rotateSegment, block });
+        // lower the block
+        out.push_back({ to.x, to.y, place, l.roll, l.pitch, grip, lowerSegment, block });
+        // release the block
+        out.push_back({ to.x, to.y, place, l.roll, l.pitch, l.openGrip, gripSegment, -1 });
+        // lift the gripper
+        out.push_back({ to.x, to.y, l.raised, l.roll, l.pitch, l.openGrip, raiseSegment, -1 });
+    }
+}
+
+#endif // HANOI_H
@@ -0,0 +1,238 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include "hanoi.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A queue of independent pick and place jobs which are reordered to cut down on travel.
+namespace jobs
+{
+    // Jobs are sent as float32 arrays, which only hold every whole number up to 2^24. Larger ids
+    // would arrive rounded and could be mixed up with another job.
+    const float maxId = 16777216;
+
+    // True if a job id came through a float32 as it was sent.
+    inline bool exactId(float id)
+    {
+        return id >= 0 && id < maxId && id == std::floor(id);
+    }
+
+    struct location
+    {
+        float x, y, z;
+    };
+
+    struct job
+    {
+        uint32_t id;
+        location pick;
+        location place;
+        float grip;     // the grip width for the block
+        double arrival; // seconds
+    };
+
+    // How long the arm takes to travel between two points at the transit height.
+    struct travel
+    {
+        float rotTime;     // seconds to rotate an eighth of a turn
+        float linearSpeed; // m/s for moving in and out or up and down
+
+        float operator()(const location &a, const location &b) const
+        {
+            float turn = std::fabs(hanoi::heading(b.x, b.y) - hanoi::heading(a.x, a.y));
+            float rotation = rotTime * turn / (M_PI / 4);
+            float distance = std::fabs(std::hypot(b.x, b.y) - std::hypot(a.x, a.y)) / linearSpeed;
+
+            return std::max(rotation, distance);
+        }
+    };
+
+    inline bool same(const location &a, const location &b, float tolerance = 0.002)
+    {
+        return std::fabs(a.x - b.x) <= tolerance && std::fabs(a.y - b.y) <= tolerance;
+    }
+
+    class queue
+    {
+        public:
+            // window is how much later than the oldest waiting job a job may arrive and still be run
+            // before it, maxLatency is how long a job may wait before it is run ahead of the rest.
+            queue(travel cost, double window, double maxLatency, size_t maxReorder = 32) :
+                cost(cost),
+                window(window),
+                maxLatency(maxLatency),
+                maxReorder(maxReorder)
+            {
+            }
+
+            void push(const job &j)
+            {
+                pending.push_back(j);
+            }
+
+            bool empty() const
+            {
+                return pending.empty();
+            }
+
+            size_t size() const
+            {
+                return pending.size();
+            }
+
+            // Takes the next batch of jobs for an arm at a location, the jobs in a batch share
+            // their pick or place location so they are run back to back.
+            void next(const location &arm, double now, std::vector<job> &batch)
+            {
+                batch.clear();
+                if (pending.empty())
+                    return;
+
+                std::stable_sort(pending.begin(), pending.end(), [](const job &a, const job &b)
+                {
+                    return a.arrival < b.arrival;
+                });
+
+                // overdue jobs go first in the order they came in
+                if (now - pending.front().arrival >= maxLatency)
+                {
+                    batch.push_back(pending.front());
+                    pending.erase(pending.begin());
+                    return;
+                }
+
+                size_t n = 0;
+                while (n < pending.size() && n < maxReorder && pending[n].arrival <= pending.front().arrival + window)
+                    n++;
+
+                std::vector<size_t> order = tour(arm, n);
+                std::vector<size_t> chosen(1, order[0]);
+
+                for (size_t i = 1; i < order.size(); i++)
+                {
+                    const job &j = pending[order[i]];
+
+                    if (!same(j.pick, pending[chosen.front()].pick) && !same(j.place, pending[chosen.back()].place))
+                        break;
+
+                    chosen.push_back(order[i]);
+                }
+
+                for (size_t i = 0; i < chosen.size(); i++)
+                    batch.push_back(pending[chosen[i]]);
+
+                std::sort(chosen.rbegin(), chosen.rend());
+                for (size_t i = 0; i < chosen.size(); i++)
+                    pending.erase(pending.begin() + chosen[i]);
+            }
+
+            // The travel time of running waiting jobs in the given order.
+            float length(const location &arm, const std::vector<size_t> &order) const
+            {
+                location at = arm;
+                float total = 0;
+
+                for (size_t i = 0; i < order.size(); i++)
+                {
+                    total += cost(at, pending[order[i]].pick) + cost(pending[order[i]].pick, pending[order[i]].place);
+                    at = pending[order[i]].place;
+                }
+
+                return total;
+            }
+
+            // A short order for the first n waiting jobs, nearest neighbour improved with 2-opt.
+            std::vector<size_t> tour(const location &arm, size_t n) const
+            {
+                std::vector<size_t> order;
+                std::vector<bool> used(n, false);
+                location at = arm;
+
+                for (size_t i = 0; i < n; i++)
+                {
+                    size_t best = n;
+                    float bestCost = 0;
+
+                    for (size_t k = 0; k < n; k++)
+                    {
+                        float c = cost(at, pending[k].pick);
+
+                        if (!used[k] && (best == n || c < bestCost))
+                        {
+                            best = k;
+                            bestCost = c;
+                        }
+                    }
+
+                    used[best] = true;
+                    order.push_back(best);
+                    at = pending[best].place;
+                }
+
+                bool improved = true;
+                float current = length(arm, order);
+
+                while (improved)
+                {
+                    improved = false;
+
+                    for (size_t i = 0; i + 1 < order.size(); i++)
+                    {
+                        for (size_t k = i + 1; k < order.size(); k++)
+                        {
+                            std::reverse(order.begin() + i, order.begin() + k + 1);
+                            float changed = length(arm, order);
+
+                            if (changed + 1e-4 < current)
+                            {
+                                current = changed;
+                                improved = true;
+                            }
+                            else
+                            {
+                                std::reverse(order.begin() + i, order.begin() + k + 1);
+                            }
+                        }
+                    }
+                }
+
+                return order;
+            }
+
+        private:
+            travel cost;
+            double window;
+            double maxLatency;
+            size_t maxReorder;
+            std::vector<job> pending;
+    };
+
+    // Appends the waypoints to carry out a job.
+    // A job does not say how heavy its block is so the block is left unset, the job controller keeps the
+    // profile waits whatever it carries.
+    inline void expand(const job &j, const hanoi::layout &l, std::vector<hanoi::waypoint> &out)
+    {
+        // turn to move over the block
+        out.push_back({ j.pick.x, j.pick.y, l.raised, l.roll, l.pitch, l.openGrip, hanoi::rotateSegment, -1 });
+        // lower onto the block
+        out.push_back({ j.pick.x, j.pick.y, j.pick.z, l.roll, l.pitch, l.openGrip, hanoi::lowerSegment, -1 });
+        // close the hand on the block
+        out.push_back({ j.pick.x, j.pick.y, j.pick.z, l.roll, l.pitch, j.grip, hanoi::gripSegment, -1 });
+        // lift up the block
+        out.push_back({ j.pick.x, j.pick.y, l.raised, l.roll, l.pitch, j.grip, hanoi::raiseSegment, -1 });
+        // move the block over the place location
+        out.push_back({ j.place.x, j.place.y, l.raised, l.roll, l.pitch, j.grip, hanoi::rotateSegment, -1 });
+        // lower the block
+        out.push_back({ j.place.x, j.place.y, j.place.z, l.roll, l.pitch, j.grip, hanoi::lowerSegment, -1 });
+        // release the block
+        out.push_back({ j.place.x, j.place.y, j.place.z, l.roll, l.pitch, l.openGrip, hanoi::gripSegment, -1 });
+        // lift the gripper
+        out.push_back({ j.place.x, j.place.y, l.raised, l.roll, l.pitch, l.openGrip, hanoi::raiseSegment, -1 });
+    }
+}
+
+#endif // JOB_QUEUE_H
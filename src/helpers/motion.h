@@ -0,0 +1,754 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include "hanoi.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Motion programs, compiled ahead of time to a flat bytecode file which is memory mapped and run
+// by a small interpreter.
+//
+// A program is a list of statements, one to a line (a \ at the end joins the next line),
+// # starts a comment:
+//   param NAME VALUE                     a named value which can be overridden at startup
+//   table NAME COLUMN... : VALUE...      rows of named columns, read as NAME[ROW].COLUMN
+//   rotate|lower|raise X Y Z ROLL PITCH HAND
+//                                        send the arm to a target, the kind sets how long to wait
+//   grip WIDTH                           open or close the hand
+//   wait                                 wait for the last target or grip to finish
+//   sleep SECONDS
+//   repeat [VAR] COUNT ... end           VAR counts from 0 and can be used as a table row
+//   forever ... end
+// Values are numbers, param names or table cells.
+namespace motion
+{
+    const uint32_t magic = 0x42434153; // "SACB"
+    const uint16_t version = 1;
+    const int maxPool = 1024; // values in a program
+    const int maxDepth = 8;   // nested loops
+    const int nameSize = 24;
+
+    enum opcode
+    {
+        opEnd,
+        opMove,   // arg is the hanoi::segment, 6 operands
+        opGrip,   // 1 operand
+        opWait,
+        opSleep,  // 1 operand
+        opRepeat, // arg is the loop counter, a count operand then the address after the loop
+        opNext,   // arg is the loop counter, then the address of the loop body
+        opJump    // then the address
+    };
+
+    // An operand word is a pool index, or a table cell with the row taken from a loop counter:
+    // bit 31 set, bits 24-30 the counter, bits 16-23 the row length, bits 0-15 the pool index.
+    const uint32_t tableOperand = 0x80000000u;
+
+    inline uint32_t instruction(opcode op, uint32_t arg = 0)
+    {
+        return op | (arg << 8);
+    }
+
+    struct header
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t numParams;
+        uint32_t poolSize;
+        uint32_t codeSize; // in words
+    };
+
+    // A param or table which can be overridden by name.
+    struct symbol
+    {
+        char name[nameSize];
+        uint32_t index; // first pool value
+        uint32_t count; // values, more than one for a table
+    };
+
+    // Turns the text of a program into bytecode.
+    class compiler
+    {
+        public:
+            // Compiles the program, on failure error holds the line and reason.
+            bool compile(const std::string &source, std::string &error)
+            {
+                std::istringstream in(source);
+                std::string line, part;
+                int number = 0;
+
+                pool.clear();
+                code.clear();
+                symbols.clear();
+                tables.clear();
+                loops.clear();
+
+                while (std::getline(in, line))
+                {
+                    int first = ++number;
+
+                    line = line.substr(0, line.find('#'));
+                    while (joined(line) && std::getline(in, part))
+                    {
+                        number++;
+                        line += " " + part.substr(0, part.find('#'));
+                    }
+
+                    std::istringstream words(line);
+                    std::vector<std::string> tokens;
+                    std::string word;
+
+                    while (words >> word)
+                        tokens.push_back(word);
+
+                    if (!tokens.empty() && !statement(tokens, error))
+                    {
+                        error = "line " + std::to_string(first) + ": " + error;
+                        return false;
+                    }
+                }
+
+                if (!loops.empty())
+                {
+                    error = "a repeat or forever has no end";
+                    return false;
+                }
+
+                code.push_back(instruction(opEnd));
+                return true;
+            }
+
+            // Writes the compiled program.
+            bool write(const std::string &path) const
+            {
+                FILE *file = std::fopen(path.c_str(), "wb");
+                header h;
+
+                if (!file)
+                    return false;
+
+                h.magic = magic;
+                h.version = version;
+                h.numParams = symbols.size();
+                h.poolSize = pool.size();
+                h.codeSize = code.size();
+
+                bool ok = std::fwrite(&h, sizeof(h), 1, file) == 1
+                       && (symbols.empty() || std::fwrite(&symbols[0], sizeof(symbol), symbols.size(), file) == symbols.size())
+                       && (pool.empty() || std::fwrite(&pool[0], sizeof(float), pool.size(), file) == pool.size())
+                       && std::fwrite(&code[0], sizeof(uint32_t), code.size(), file) == code.size();
+
+                return std::fclose(file) == 0 && ok;
+            }
+
+        private:
+            struct table
+            {
+                uint32_t index;
+                std::vector<std::string> columns;
+                uint32_t rows;
+            };
+
+            struct loop
+            {
+                std::string var;
+                int counter; // -1 for forever
+                uint32_t start;
+                uint32_t patch; // the word to fill in with the end address
+            };
+
+            bool statement(const std::vector<std::string> &t, std::string &error)
+            {
+                const std::string &s = t[0];
+
+                if (s == "param")
+                    return param(t, error);
+                if (s == "table")
+                    return addTable(t, error);
+
+                if (s == "rotate" || s == "lower" || s == "raise")
+                {
+                    if (t.size() != 7)
+                        return fail(error, s + " takes x y z roll pitch hand");
+
+                    hanoi::segment kind = s == "rotate" ? hanoi::rotateSegment
+                                        : s == "lower" ? hanoi::lowerSegment : hanoi::raiseSegment;
+                    code.push_back(instruction(opMove, kind));
+                    return operands(t, 1, 6, error);
+                }
+
+                if (s == "grip" || s == "sleep")
+                {
+                    if (t.size() != 2)
+                        return fail(error, s + " takes one value");
+
+                    code.push_back(instruction(s == "grip" ? opGrip : opSleep));
+                    return operands(t, 1, 1, error);
+                }
+
+                if (s == "wait")
+                {
+                    if (t.size() != 1)
+                        return fail(error, "wait takes no values");
+
+                    code.push_back(instruction(opWait));
+                    return true;
+                }
+
+                if (s == "repeat")
+                {
+                    if (t.size() != 2 && t.size() != 3)
+                        return fail(error, "repeat takes an optional counter name and a count");
+                    if (loops.size() >= (size_t)maxDepth)
+                        return fail(error, "loops are nested too deep");
+
+                    loop l;
+                    l.var = t.size() == 3 ? t[1] : "";
+                    l.counter = counters();
+                    code.push_back(instruction(opRepeat, l.counter));
+                    if (!operands(t, t.size() - 1, 1, error))
+                        return false;
+                    l.patch = code.size();
+                    code.push_back(0);
+                    l.start = code.size();
+                    loops.push_back(l);
+                    return true;
+                }
+
+                if (s == "forever")
+                {
+                    if (t.size() != 1)
+                        return fail(error, "forever takes no values");
+
+                    loop l;
+                    l.counter = -1;
+                    l.start = code.size();
+                    l.patch = 0;
+                    loops.push_back(l);
+                    return true;
+                }
+
+                if (s == "end")
+                {
+                    if (loops.empty())
+                        return fail(error, "end without a repeat or forever");
+
+                    loop l = loops.back();
+                    loops.pop_back();
+
+                    if (l.counter < 0)
+                    {
+                        code.push_back(instruction(opJump));
+                        code.push_back(l.start);
+                    }
+                    else
+                    {
+                        code.push_back(instruction(opNext, l.counter));
+                        code.push_back(l.start);
+                        code[l.patch] = code.size();
+                    }
+                    return true;
+                }
+
+                return fail(error, "unknown statement " + s);
+            }
+
+            bool param(const std::vector<std::string> &t, std::string &error)
+            {
+                float value;
+
+                if (t.size() != 3 || !literal(t[2], value))
+                    return fail(error, "param takes a name and a number");
+                if (!define(t[1], 1, error))
+                    return false;
+
+                pool.push_back(value);
+                return true;
+            }
+
+            bool addTable(const std::vector<std::string> &t, std::string &error)
+            {
+                size_t colon = 2;
+
+                while (colon < t.size() && t[colon] != ":")
+                    colon++;
+
+                table tab;
+                tab.columns.assign(t.begin() + 2, t.begin() + colon);
+                size_t values = colon < t.size() ? t.size() - colon - 1 : 0;
+
+                if (tab.columns.empty() || values == 0 || values % tab.columns.size() != 0 || tab.columns.size() > 255)
+                    return fail(error, "table takes a name, its columns, a : and whole rows of values");
+
+                tab.index = pool.size();
+                tab.rows = values / tab.columns.size();
+                if (!define(t[1], values, error))
+                    return false;
+
+                for (size_t i = colon + 1; i < t.size(); i++)
+                {
+                    float value;
+
+                    if (!literal(t[i], value))
+                        return fail(error, t[i] + " is not a number");
+                    pool.push_back(value);
+                }
+
+                tables[t[1]] = tab;
+                return true;
+            }
+
+            bool define(const std::string &name, size_t count, std::string &error)
+            {
+                if (name.size() >= (size_t)nameSize)
+                    return fail(error, "the name " + name + " is too long");
+                if (find(name) || tables.count(name))
+                    return fail(error, name + " is already defined");
+                if (pool.size() + count > (size_t)maxPool)
+                    return fail(error, "the program has too many values");
+
+                symbol s;
+                std::memset(&s, 0, sizeof(s));
+                std::strncpy(s.name, name.c_str(), nameSize - 1);
+                s.index = pool.size();
+                s.count = count;
+                symbols.push_back(s);
+                return true;
+            }
+
+            const symbol *find(const std::string &name) const
+            {
+                for (size_t i = 0; i < symbols.size(); i++)
+                    if (name == symbols[i].name)
+                        return &symbols[i];
+
+                return 0;
+            }
+
+            int counters() const
+            {
+                int n = 0;
+
+                for (size_t i = 0; i < loops.size(); i++)
+                    if (loops[i].counter >= 0)
+                        n++;
+
+                return n;
+            }
+
+            bool operands(const std::vector<std::string> &t, size_t first, size_t count, std::string &error)
+            {
+                for (size_t i = first; i < first + count; i++)
+                {
+                    uint32_t word;
+
+                    if (!operand(t[i], word, error))
+                        return false;
+                    code.push_back(word);
+                }
+
+                return true;
+            }
+
+            // A number, a param or NAME[ROW].COLUMN where ROW is a number or a loop counter.
+            bool operand(const std::string &token, uint32_t &word, std::string &error)
+            {
+                float value;
+
+                if (literal(token, value))
+                {
+                    if (pool.size() >= (size_t)maxPool)
+                        return fail(error, "the program has too many values");
+
+                    word = pool.size();
+                    pool.push_back(value);
+                    return true;
+                }
+
+                size_t open = token.find('[');
+
+                if (open == std::string::npos)
+                {
+                    const symbol *s = find(token);
+
+                    if (!s || s->count != 1)
+                        return fail(error, token + " is not a param");
+
+                    word = s->index;
+                    return true;
+                }
+
+                size_t close = token.find("].", open);
+                std::map<std::string, table>::const_iterator tab = tables.find(token.substr(0, open));
+
+                if (close == std::string::npos || tab == tables.end())
+                    return fail(error, token + " is not a table cell");
+
+                std::string row = token.substr(open + 1, close - open - 1);
+                std::string column = token.substr(close + 2);
+                size_t c = 0;
+
+                while (c < tab->second.columns.size() && tab->second.columns[c] != column)
+                    c++;
+                if (c == tab->second.columns.size())
+                    return fail(error, column + " is not a column of " + tab->first);
+
+                uint32_t width = tab->second.columns.size();
+
+                if (literal(row, value))
+                {
+                    if (value < 0 || value >= tab->second.rows || value != (int)value)
+                        return fail(error, "row " + row + " is not in " + tab->first);
+
+                    word = tab->second.index + (uint32_t)value * width + c;
+                    return true;
+                }
+
+                // the row comes from a loop counter, the innermost loop with the name wins and the
+                // interpreter keeps the row inside the table
+                for (size_t i = loops.size(); i-- > 0;)
+                {
+                    if (loops[i].var == row && !row.empty())
+                    {
+                        word = tableOperand | (loops[i].counter << 24) | (width << 16) | (tab->second.index + c);
+                        return true;
+                    }
+                }
+
+                return fail(error, row + " is not a number or a loop counter");
+            }
+
+            // Removes a \ from the end of the line, true if there was one.
+            static bool joined(std::string &line)
+            {
+                size_t end = line.find_last_not_of(" \t\r");
+
+                if (end == std::string::npos || line[end] != '\\')
+                    return false;
+
+                line.erase(end);
+                return true;
+            }
+
+            static bool literal(const std::string &token, float &value)
+            {
+                char *end;
+
+                value = std::strtof(token.c_str(), &end);
+                return !token.empty() && *end == 0;
+            }
+
+            static bool fail(std::string &error, const std::string &reason)
+            {
+                error = reason;
+                return false;
+            }
+
+            std::vector<float> pool;
+            std::vector<uint32_t> code;
+            std::vector<symbol> symbols;
+            std::map<std::string, table> tables;
+            std::vector<loop> loops;
+    };
+
+    // A compiled program mapped read only.
+    class image
+    {
+        public:
+            image(const std::string &path) :
+                data(0),
+                size(0),
+                valid(false)
+            {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                struct stat info;
+
+                if (fd < 0)
+                    return;
+
+                if (::fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(header))
+                {
+                    size = info.st_size;
+                    data = ::mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (data == MAP_FAILED)
+                        data = 0;
+                }
+                ::close(fd);
+
+                valid = data && check();
+            }
+
+            ~image()
+            {
+                if (data)
+                    ::munmap(data, size);
+            }
+
+            bool isValid() const
+            {
+                return valid;
+            }
+
+            const header &head() const
+            {
+                return *(const header *)data;
+            }
+
+            const symbol *symbols() const
+            {
+                return (const symbol *)((const char *)data + sizeof(header));
+            }
+
+            const float *pool() const
+            {
+                return (const float *)(symbols() + head().numParams);
+            }
+
+            const uint32_t *code() const
+            {
+                return (const uint32_t *)(pool() + head().poolSize);
+            }
+
+            // The param or table holding a pool value, 0 for a literal.
+            const symbol *symbolOf(uint32_t index) const
+            {
+                for (int i = 0; i < head().numParams; i++)
+                {
+                    const symbol &s = symbols()[i];
+
+                    if (index >= s.index && index < s.index + s.count)
+                        return &s;
+                }
+
+                return 0;
+            }
+
+        private:
+            image(const image &);
+            image &operator=(const image &);
+
+            // Checks every instruction so the interpreter never has to.
+            bool check() const
+            {
+                const header &h = head();
+
+                if (h.magic != magic || h.version != version || h.poolSize > (uint32_t)maxPool || h.codeSize == 0)
+                    return false;
+                if (size != sizeof(header) + h.numParams * sizeof(symbol) + h.poolSize * sizeof(float) + h.codeSize * sizeof(uint32_t))
+                    return false;
+
+                for (int i = 0; i < h.numParams; i++)
+                    if (symbols()[i].index + symbols()[i].count > h.poolSize)
+                        return false;
+
+                const uint32_t *c = code();
+                std::vector<bool> starts(h.codeSize, false);
+                std::vector<uint32_t> targets;
+
+                for (uint32_t pc = 0; pc < h.codeSize; )
+                {
+                    starts[pc] = true;
+
+                    uint32_t op = c[pc] & 0xff;
+                    uint32_t arg = c[pc] >> 8;
+                    uint32_t words = op == opMove ? 6 : op == opRepeat ? 2
+                                   : op == opGrip || op == opSleep || op == opNext || op == opJump ? 1 : 0;
+
+                    if (op > opJump || pc + words >= h.codeSize)
+                        return false;
+                    if (op == opMove && arg > hanoi::raiseSegment)
+                        return false;
+                    if ((op == opRepeat || op == opNext) && arg >= (uint32_t)maxDepth)
+                        return false;
+
+                    for (uint32_t i = 1; i <= words; i++)
+                    {
+                        uint32_t w = c[pc + i];
+                        bool address = op == opJump || op == opNext || (op == opRepeat && i == 2);
+
+                        if (address)
+                            targets.push_back(w);
+                        else if (!operandValid(w))
+                            return false;
+                    }
+
+                    pc += 1 + words;
+                }
+
+                // a jump into the operands of an instruction would run them unchecked
+                for (size_t i = 0; i < targets.size(); i++)
+                    if (targets[i] >= h.codeSize || !starts[targets[i]])
+                        return false;
+
+                // the last word has to be an end instruction, not an operand which reads as one
+                return starts[h.codeSize - 1] && c[h.codeSize - 1] == instruction(opEnd);
+            }
+
+            // A table operand has to point at a cell in the first row of a table (or param).
+            bool operandValid(uint32_t w) const
+            {
+                if (!(w & tableOperand))
+                    return w < head().poolSize;
+
+                uint32_t base = w & 0xffff;
+                uint32_t width = (w >> 16) & 0xff;
+                const symbol *s = symbolOf(base);
+
+                return ((w >> 24) & 0x7f) < (uint32_t)maxDepth && s && width > 0 &&
+                       base - s->index < width && s->count % width == 0;
+            }
+
+
+            void *data;
+            size_t size;
+            bool valid;
+    };
+
+    // Runs a program, the sink carries out each action:
+    //   void move(const hanoi::waypoint &w)  send the arm (and hand) to a target
+    //   void grip(float width)               send the hand
+    //   void wait()                          wait for the last move or grip
+    //   void sleep(float seconds)
+    //   bool ok()                            false to stop the program
+    // Nothing is allocated while running.
+    class machine
+    {
+        public:
+            machine(const image &program) :
+                program(program)
+            {
+                std::memcpy(pool, program.pool(), program.head().poolSize * sizeof(float));
+
+                // where the table of each value ends, a loop counter past the last row reads nothing else
+                for (uint32_t i = 0; i < program.head().poolSize; i++)
+                {
+                    const symbol *s = program.symbolOf(i);
+
+                    tableEnd[i] = s ? s->index + s->count : 0;
+                }
+            }
+
+            // Replaces the values of a param or table, false if there is no such name or the count differs.
+            bool set(const char *name, const float *values, size_t count)
+            {
+                for (int i = 0; i < program.head().numParams; i++)
+                {
+                    const symbol &s = program.symbols()[i];
+
+                    if (std::strncmp(s.name, name, nameSize) == 0)
+                    {
+                        if (s.count != count)
+                            return false;
+
+                        std::memcpy(pool + s.index, values, count * sizeof(float));
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            // Runs the program to its end, false if a loop counter ran past the last row of a table.
+            template <class Sink>
+            bool run(Sink &sink)
+            {
+                const uint32_t *code = program.code();
+                uint32_t counter[maxDepth] = { 0 };
+                uint32_t limit[maxDepth] = { 0 };
+                hanoi::waypoint last = { 0, 0, 0, 0, 0, 0, hanoi::raiseSegment, -1 };
+                uint32_t pc = 0;
+
+                while (sink.ok())
+                {
+                    uint32_t op = code[pc] & 0xff;
+                    uint32_t arg = code[pc] >> 8;
+                    float v[6];
+
+                    switch (op)
+                    {
+                        case opMove:
+                            for (int i = 0; i < 6; i++)
+                                if (!value(code[pc + 1 + i], counter, v[i]))
+                                    return false;
+
+                            last = { v[0], v[1], v[2], v[3], v[4], v[5], (hanoi::segment)arg, -1 }; // programs do not track the payload
+                            sink.move(last);
+                            pc += 7;
+                            break;
+                        case opGrip:
+                            if (!value(code[pc + 1], counter, v[0]))
+                                return false;
+
+                            sink.grip(v[0]);
+                            pc += 2;
+                            break;
+                        case opWait:
+                            sink.wait();
+                            pc += 1;
+                            break;
+                        case opSleep:
+                            if (!value(code[pc + 1], counter, v[0]))
+                                return false;
+
+                            sink.sleep(v[0]);
+                            pc += 2;
+                            break;
+                        case opRepeat:
+                            if (!value(code[pc + 1], counter, v[0]))
+                                return false;
+
+                            counter[arg] = 0;
+                            limit[arg] = v[0] > 0 ? (uint32_t)v[0] : 0;
+                            pc = limit[arg] > 0 ? pc + 3 : code[pc + 2];
+                            break;
+                        case opNext:
+                            pc = ++counter[arg] < limit[arg] ? code[pc + 1] : pc + 2;
+                            break;
+                        case opJump:
+                            pc = code[pc + 1];
+                            break;
+                        default:
+                            return true;
+                    }
+                }
+
+                return true;
+            }
+
+        private:
+            bool value(uint32_t word, const uint32_t *counter, float &out) const
+            {
+                if (!(word & tableOperand))
+                {
+                    out = pool[word];
+                    return true;
+                }
+
+                uint32_t base = word & 0xffff;
+                uint32_t index = base + counter[(word >> 24) & 0x7f] * ((word >> 16) & 0xff);
+
+                if (index >= tableEnd[base])
+                    return false;
+
+                out = pool[index];
+                return true;
+            }
+
+            const image &program;
+            float pool[maxPool];
+            uint32_t tableEnd[maxPool];
+    };
+}
+
+#endif // MOTION_H
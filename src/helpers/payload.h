@@ -0,0 +1,71 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include "hanoi.h"
+
+// Speed and acceleration scaling for what the gripper is holding.
+// The scaling lowers the joint limits the time optimal timing is worked out with. The open loop waits
+// are never shortened by it, they are learned for each load from how long the arm really takes.
+namespace payload
+{
+    enum load
+    {
+        empty,
+        light,
+        medium,
+        heavy
+    };
+
+    const int numLoads = 4;
+
+    inline const char *name(load l)
+    {
+        switch (l)
+        {
+            case empty:  return "empty";
+            case light:  return "light";
+            case medium: return "medium";
+            case heavy:  return "heavy";
+        }
+
+        return "unknown";
+    }
+
+    // Fractions of the joint velocity and acceleration limits.
+    struct scaling
+    {
+        float speed;
+        float acceleration;
+    };
+
+    const scaling profiles[] = {
+        { 1.00, 1.00 }, // empty
+        { 1.00, 1.00 }, // light
+        { 0.85, 0.70 }, // medium
+        { 0.60, 0.45 }  // heavy
+    };
+
+    // Block 0 is the largest, the blocks are split into thirds from heaviest to lightest.
+    inline load classOf(int block, int numBlocks)
+    {
+        if (block < 0)
+            return empty;
+        if (block * 3 < numBlocks)
+            return heavy;
+        if (block * 3 < 2 * numBlocks)
+            return medium;
+
+        return light;
+    }
+
+    // The load a waypoint is reached with, the gripper opens and closes the same whatever it holds.
+    inline load loadOf(const hanoi::waypoint &w, int numBlocks)
+    {
+        if (w.kind == hanoi::gripSegment)
+            return empty;
+
+        return classOf(w.block, numBlocks);
+    }
+}
+
+#endif // PAYLOAD_H
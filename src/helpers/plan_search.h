@@ -0,0 +1,439 @@
+#ifndef PLAN_SEARCH_H
+#define PLAN_SEARCH_H
+
+#include "hanoi.h"
+#include "payload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Searches the ways of running the Towers of Hanoi for the shortest cycle time.
+// A candidate picks the peg the tower is shown on, the transit height and how far the gripper opens
+// around a block. Candidates are scored with a motion time model on every core and the winner is
+// cached by configuration so the search only runs once for a setup.
+namespace search
+{
+    const float minScale = 0.25; // even a short lift or grip takes a quarter of the full one
+    const float margin = 0.020;  // clearance over the stacks when moving at the lowest height
+
+    struct options
+    {
+        int goal;        // the peg the tower is moved to before it comes back
+        float raised;    // transit height, 0 for just above the stacks passed over
+        float clearance; // how much wider than the block the gripper opens, 0 opens fully
+    };
+
+    struct plan
+    {
+        options opt;
+        std::vector<hanoi::move> moves;
+        std::vector<float> raised; // the transit height of each move
+        float cost;                // predicted seconds for one cycle, INFINITY if it cannot be run
+    };
+
+    // The full lift and grip which the wait times of the arm profile are for.
+    struct references
+    {
+        float lift; // m
+        float grip; // m
+    };
+
+    inline references referencesOf(const hanoi::layout &l, int numBlocks)
+    {
+        float smallest = l.openGrip;
+
+        for (int i = 0; i < numBlocks; i++)
+            smallest = std::min(smallest, l.blockGrip[i]);
+
+        return { l.raised - l.lift, l.openGrip - smallest };
+    }
+
+    // How much of a full segment the motion from one waypoint to the next is, rotations are in
+    // eighths of a turn like the rotWait of the arm profile.
+    inline float scale(const hanoi::waypoint &from, const hanoi::waypoint &to, const references &r)
+    {
+        switch (to.kind)
+        {
+            case hanoi::rotateSegment:
+                return std::fabs(hanoi::heading(to.x, to.y) - hanoi::heading(from.x, from.y)) / (M_PI / 4);
+            case hanoi::gripSegment:
+                return std::max(minScale, std::fabs(to.hand - from.hand) / r.grip);
+            default:
+                return std::max(minScale, std::fabs(to.z - from.z) / r.lift);
+        }
+    }
+
+    // The pegs passed over when turning from one peg to another, both included.
+    inline unsigned swept(const hanoi::layout &l, int from, int to)
+    {
+        float a = hanoi::heading(l.pegs[from].x, l.pegs[from].y);
+        float b = hanoi::heading(l.pegs[to].x, l.pegs[to].y);
+        unsigned pegs = 0;
+
+        for (int p = 0; p < hanoi::numPegs; p++)
+        {
+            float h = hanoi::heading(l.pegs[p].x, l.pegs[p].y);
+
+            if (h >= std::min(a, b) - 1e-3 && h <= std::max(a, b) + 1e-3)
+                pegs |= 1u << p;
+        }
+
+        return pegs;
+    }
+
+    inline float tallest(const hanoi::world &w, const hanoi::layout &l, unsigned pegs)
+    {
+        float height = 0;
+
+        for (int p = 0; p < hanoi::numPegs; p++)
+            if (pegs & (1u << p))
+                height = std::max(height, w.heightBelow(p, w.blocks(), l.blockHeight));
+
+        return height;
+    }
+
+    // The lowest transit height for a move where the empty gripper clears the stacks on its way
+    // from the last peg and the carried block clears them on its way to the next.
+    inline float lowest(hanoi::world w, hanoi::move m, int last, const hanoi::layout &l)
+    {
+        float approach = tallest(w, l, swept(l, last, m.from)) + margin;
+
+        w.apply(m);
+        w.place(w.top(m.to), -1); // the block is in the gripper, not on a peg
+        float carry = tallest(w, l, swept(l, m.from, m.to)) + l.lift + margin;
+
+        return std::max(approach, carry);
+    }
+
+    // The layout for one move of a plan.
+    inline hanoi::layout layoutOf(const plan &p, size_t index, const hanoi::world &w, const hanoi::layout &base)
+    {
+        hanoi::layout l = base;
+
+        l.raised = p.raised[index];
+        if (p.opt.clearance > 0)
+            l.openGrip = std::min(base.openGrip, base.blockGrip[w.top(p.moves[index].from)] + p.opt.clearance);
+
+        return l;
+    }
+
+    // Appends the waypoints of a move of the plan.
+    inline void expand(const plan &p, size_t index, const hanoi::world &w, const hanoi::layout &base,
+                       std::vector<hanoi::waypoint> &out)
+    {
+        hanoi::expand(w, p.moves[index], layoutOf(p, index, w, base), out);
+    }
+
+    // Builds the moves and transit heights of a candidate, the cost is left at 0.
+    inline plan build(const options &opt, int numBlocks, int start, const hanoi::layout &base)
+    {
+        plan p;
+        hanoi::world w(numBlocks, start);
+
+        p.opt = opt;
+        p.cost = 0;
+        hanoi::solve(numBlocks, start, opt.goal, p.moves);
+        hanoi::solve(numBlocks, opt.goal, start, p.moves);
+
+        for (size_t i = 0; i < p.moves.size(); i++)
+        {
+            int last = p.moves[i == 0 ? p.moves.size() - 1 : i - 1].to; // the plan runs in a loop
+            float low = lowest(w, p.moves[i], last, base);
+
+            // a fixed height which hits a stack rules the candidate out
+            if (opt.raised > 0 && opt.raised < low)
+                p.cost = INFINITY;
+
+            p.raised.push_back(opt.raised > 0 ? opt.raised : low);
+            w.apply(p.moves[i]);
+        }
+
+        return p;
+    }
+
+    // The predicted time of one cycle of the plan, unit is the time of a full segment of each kind
+    // with each load.
+    inline float cycleTime(const plan &p, int numBlocks, int start, const hanoi::layout &base,
+                           const float unit[][payload::numLoads],
+                           const std::function<bool(const hanoi::waypoint &)> &reachable)
+    {
+        std::vector<hanoi::waypoint> path;
+        hanoi::world w(numBlocks, start);
+        references r = referencesOf(base, numBlocks);
+
+        for (size_t i = 0; i < p.moves.size(); i++)
+        {
+            expand(p, i, w, base, path);
+            w.apply(p.moves[i]);
+        }
+
+        float total = 0;
+        hanoi::waypoint last = path.back();
+
+        for (size_t i = 0; i < path.size(); i++)
+        {
+            if (!reachable(path[i]))
+                return INFINITY;
+
+            total += unit[path[i].kind][payload::loadOf(path[i], numBlocks)] * scale(last, path[i], r);
+            last = path[i];
+        }
+
+        return total;
+    }
+
+    // Every combination of goal peg, transit height and gripper clearance, goal -1 tries every peg.
+    inline std::vector<options> candidates(int start, int goal, float raised)
+    {
+        const float heights[] = { 0, raised, 0.150, 0.100 };
+        const float clearances[] = { 0, 0.020, 0.010 };
+        std::vector<options> out;
+
+        for (int g = 0; g < hanoi::numPegs; g++)
+        {
+            if (g == start || (goal >= 0 && g != goal))
+                continue;
+
+            for (float h : heights)
+                for (float c : clearances)
+                    out.push_back({ g, h, c });
+        }
+
+        return out;
+    }
+
+    // Scores the candidates on a pool of threads and returns the fastest.
+    inline plan best(const std::vector<options> &opts, int numBlocks, int start, const hanoi::layout &base,
+                     const float unit[][payload::numLoads],
+                     const std::function<bool(const hanoi::waypoint &)> &reachable,
+                     unsigned threads = std::thread::hardware_concurrency())
+    {
+        std::vector<plan> plans(opts.size());
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> pool;
+
+        if (plans.empty())
+        {
+            plan none;
+            none.cost = INFINITY;
+            return none;
+        }
+
+        auto work = [&]()
+        {
+            for (size_t i = next++; i < plans.size(); i = next++)
+            {
+                plans[i] = build(opts[i], numBlocks, start, base);
+                if (plans[i].cost == 0)
+                    plans[i].cost = cycleTime(plans[i], numBlocks, start, base, unit, reachable);
+            }
+        };
+
+        for (unsigned t = 1; t < std::max(1u, threads); t++)
+            pool.push_back(std::thread(work));
+        work();
+
+        for (size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+
+        // the first of equal plans wins so the choice does not depend on the threads
+        size_t winner = 0;
+        for (size_t i = 1; i < plans.size(); i++)
+            if (plans[i].cost < plans[winner].cost)
+                winner = i;
+
+        return plans[winner];
+    }
+
+    // A key for everything the choice of plan depends on.
+    inline uint64_t keyOf(const char *arm, int numBlocks, int start, int goal, const hanoi::layout &l,
+                          const float unit[][payload::numLoads])
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&](const void *data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= ((const unsigned char *)data)[i];
+                hash *= 1099511628211ull;
+            }
+        };
+
+        add(arm, std::strlen(arm));
+        add(&numBlocks, sizeof(numBlocks));
+        add(&start, sizeof(start));
+        add(&goal, sizeof(goal));
+        add(&l, sizeof(l));
+
+        // learned times move a little every cycle, only a real change in them starts a new search
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < payload::numLoads; j++)
+            {
+                int32_t step = (int32_t)std::lround(unit[i][j] * 2);
+                add(&step, sizeof(step));
+            }
+        }
+
+        return hash;
+    }
+
+    // The chosen options for the most recently used configurations, kept in an append only file.
+    // The key changes with the learned times, so only capacity configurations are kept and the least
+    // recently used is dropped, the file is written again once it holds twice as many records.
+    class cache
+    {
+        public:
+            cache(const std::string &path, size_t capacity = defaultCapacity) :
+                path(path),
+                capacity(std::max<size_t>(1, capacity)),
+                tick(0),
+                records(0)
+            {
+                FILE *file = std::fopen(path.c_str(), "rb");
+                record r;
+
+                if (!file)
+                    return;
+
+                // later records are the more recently used
+                while (std::fread(&r, sizeof(r), 1, file) == 1)
+                {
+                    if (r.magic == magic)
+                    {
+                        chosen[r.key] = { r.opt, ++tick };
+                        records++;
+                    }
+                }
+
+                std::fclose(file);
+
+                if (evict() || records > 2 * this->capacity)
+                    rewrite();
+            }
+
+            bool find(uint64_t key, options &out)
+            {
+                std::map<uint64_t, entry>::iterator i = chosen.find(key);
+
+                if (i == chosen.end())
+                    return false;
+
+                out = i->second.opt;
+                // written again so the file keeps the order of use across runs
+                store(key, out);
+                return true;
+            }
+
+            bool store(uint64_t key, const options &opt)
+            {
+                chosen[key] = { opt, ++tick };
+
+                if (evict() || records + 1 > 2 * capacity)
+                    return rewrite();
+
+                FILE *file = std::fopen(path.c_str(), "ab");
+                if (!file)
+                    return false;
+
+                bool ok = write(file, key, opt);
+                records++;
+                return std::fclose(file) == 0 && ok;
+            }
+
+        private:
+            static const uint32_t magic = 0x50434153; // "SACP"
+            static const size_t defaultCapacity = 32;
+
+            struct record
+            {
+                uint32_t magic;
+                uint64_t key;
+                options opt;
+            };
+
+            struct entry
+            {
+                options opt;
+                uint64_t used; // tick of the last find or store, later is more recent
+            };
+
+            static bool write(FILE *file, uint64_t key, const options &opt)
+            {
+                record r;
+
+                std::memset(&r, 0, sizeof(r));
+                r.magic = magic;
+                r.key = key;
+                r.opt = opt;
+                return std::fwrite(&r, sizeof(r), 1, file) == 1;
+            }
+
+            // Drops the least recently used configurations over capacity, true if any were dropped.
+            bool evict()
+            {
+                bool dropped = false;
+
+                while (chosen.size() > capacity)
+                {
+                    std::map<uint64_t, entry>::iterator oldest = chosen.begin();
+
+                    for (std::map<uint64_t, entry>::iterator i = chosen.begin(); i != chosen.end(); ++i)
+                        if (i->second.used < oldest->second.used)
+                            oldest = i;
+
+                    chosen.erase(oldest);
+                    dropped = true;
+                }
+
+                return dropped;
+            }
+
+            // Writes the kept configurations to a new file, least recently used first, and moves it over the old one.
+            bool rewrite()
+            {
+                std::vector<std::pair<uint64_t, uint64_t> > order; // used, key
+                std::string next = path + ".tmp";
+                FILE *file = std::fopen(next.c_str(), "wb");
+                bool ok = file != 0;
+
+                for (std::map<uint64_t, entry>::const_iterator i = chosen.begin(); i != chosen.end(); ++i)
+                    order.push_back(std::make_pair(i->second.used, i->first));
+                std::sort(order.begin(), order.end());
+
+                for (size_t i = 0; ok && i < order.size(); i++)
+                    ok = write(file, order[i].second, chosen[order[i].second].opt);
+
+                if (file)
+                    ok = std::fclose(file) == 0 && ok;
+                if (ok)
+                    ok = std::rename(next.c_str(), path.c_str()) == 0;
+                if (!ok)
+                {
+                    std::remove(next.c_str());
+                    return false;
+                }
+
+                records = order.size();
+                return true;
+            }
+
+            std::string path;
+            size_t capacity;
+            uint64_t tick;
+            size_t records; // records in the file, a configuration stored again is there more than once
+            std::map<uint64_t, entry> chosen;
+    };
+}
+
+#endif // PLAN_SEARCH_H
@@ -0,0 +1,209 @@
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include "arm_profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Checks targets against an arm profile before they are sent to the planner.
+// The arm is modelled as a base rotation and a planar shoulder, elbow and wrist pitch.
+namespace reach
+{
+    enum status
+    {
+        reachable,
+        clamped,            // the target was moved to the nearest valid value
+        outsideGripRange,
+        outsideBounds,      // beyond the reach or height limits of the arm
+        outsideJointLimits, // the base or roll would have to turn too far
+        outOfReach          // inside the bounds but the arm cannot get there
+    };
+
+    inline const char *reason(status s)
+    {
+        switch (s)
+        {
+            case reachable:          return "reachable";
+            case clamped:            return "clamped to the workspace";
+            case outsideGripRange:   return "the grip width is outside of the gripper range";
+            case outsideBounds:      return "the target is outside of the workspace bounds";
+            case outsideJointLimits: return "the base or roll is outside of its joint limits";
+            case outOfReach:         return "no arm pose reaches the target";
+        }
+
+        return "unknown";
+    }
+
+    struct target
+    {
+        float x, y, z;
+        float roll, pitch;
+        float hand;
+    };
+
+    inline bool within(const arms::jointLimit &limit, float angle)
+    {
+        return angle >= limit.min && angle <= limit.max;
+    }
+
+    // The shoulder, elbow and wrist angles of the planar arm for a grip point at a distance r from
+    // the base axis and height z, side -1 is elbow down and 1 elbow up.
+    // pitch is the angle of the tool below the horizontal (pi / 2 points straight down).
+    inline bool inverse(const arms::profile &p, float r, float z, float pitch, int side, float out[3])
+    {
+        float wr = r - p.tool * std::cos(pitch) - p.shoulderOffset;
+        float wz = z + p.tool * std::sin(pitch) - p.shoulderHeight;
+        float a = p.upperArm;
+        float b = p.forearm;
+        float c = (wr * wr + wz * wz - a * a - b * b) / (2 * a * b);
+
+        if (c < -1 || c > 1)
+            return false;
+
+        float elbow = side * std::acos(c);
+        float shoulder = std::atan2(wz, wr) - std::atan2(b * std::sin(elbow), a + b * std::cos(elbow));
+        float wrist = -pitch - shoulder - elbow;
+
+        out[0] = shoulder;
+        out[1] = elbow;
+        out[2] = wrist;
+
+        return within(p.joints[1], shoulder) && within(p.joints[2], elbow) && within(p.joints[3], wrist);
+    }
+
+    // Solves the planar arm for a grip point, see inverse().
+    inline bool solve(const arms::profile &p, float r, float z, float pitch)
+    {
+        float angles[3];
+
+        // try elbow down then elbow up
+        return inverse(p, r, z, pitch, -1, angles) || inverse(p, r, z, pitch, 1, angles);
+    }
+
+    // A precomputed grid over distance, height and pitch for one arm.
+    // Cells which are fully inside or outside the reachable space are answered from the grid,
+    // cells on the edge and pitches between the grid steps fall back to solving the arm.
+    template <class Arm>
+    class workspace
+    {
+        public:
+            static const workspace &get()
+            {
+                static const workspace grid;
+                return grid;
+            }
+
+            bool reachable(float r, float z, float pitch) const
+            {
+                const arms::profile p = Arm::table();
+
+                if (r < 0 || r > p.maxReach || z < p.minHeight || z > p.maxHeight)
+                    return false;
+
+                float step = (pitch - minPitch) / pitchStep;
+                int k = (int)std::lround(step);
+
+                if (k < 0 || k >= pitchBins || std::fabs(step - k) > 1e-3)
+                    return solve(p, r, z, pitch);
+
+                int i = std::min((int)(r / cellSize), rCells - 1);
+                int j = std::min((int)((z - p.minHeight) / cellSize), zCells - 1);
+                unsigned char cell = cells[(k * rCells + i) * zCells + j];
+
+                return cell == inside || (cell == edge && solve(p, r, z, pitch));
+            }
+
+        private:
+            enum { outside, inside, edge };
+
+            static const int pitchBins = 17; // -pi / 2 to pi / 2 in sixteenths of a turn
+
+            workspace() :
+                minPitch(-M_PI / 2),
+                pitchStep(M_PI / (pitchBins - 1)),
+                rCells((int)std::ceil(Arm::table().maxReach / cellSize)),
+                zCells((int)std::ceil((Arm::table().maxHeight - Arm::table().minHeight) / cellSize)),
+                cells(pitchBins * rCells * zCells)
+            {
+                const arms::profile p = Arm::table();
+                std::vector<unsigned char> corners((rCells + 1) * (zCells + 1));
+
+                for (int k = 0; k < pitchBins; k++)
+                {
+                    float pitch = minPitch + k * pitchStep;
+
+                    for (int i = 0; i <= rCells; i++)
+                        for (int j = 0; j <= zCells; j++)
+                            corners[i * (zCells + 1) + j] = solve(p, i * cellSize, p.minHeight + j * cellSize, pitch);
+
+                    for (int i = 0; i < rCells; i++)
+                    {
+                        for (int j = 0; j < zCells; j++)
+                        {
+                            int count = corners[i * (zCells + 1) + j] + corners[i * (zCells + 1) + j + 1]
+                                      + corners[(i + 1) * (zCells + 1) + j] + corners[(i + 1) * (zCells + 1) + j + 1];
+
+                            cells[(k * rCells + i) * zCells + j] = count == 4 ? inside : count == 0 ? outside : edge;
+                        }
+                    }
+                }
+            }
+
+            static constexpr float cellSize = 0.005;
+
+            float minPitch;
+            float pitchStep;
+            int rCells;
+            int zCells;
+            std::vector<unsigned char> cells;
+    };
+
+    template <class Arm>
+    constexpr float workspace<Arm>::cellSize;
+
+    // Checks a target for the arm, with clamp the grip and height are moved back into range
+    // and the target is pulled in to the maximum reach instead of being rejected.
+    template <class Arm>
+    status check(target &t, bool clamp)
+    {
+        const arms::profile p = Arm::table();
+        status result = reachable;
+        float r = std::hypot(t.x, t.y);
+
+        if (t.hand < p.minGrip || t.hand > p.maxGrip)
+        {
+            if (!clamp)
+                return outsideGripRange;
+
+            t.hand = std::min(std::max(t.hand, p.minGrip), p.maxGrip);
+            result = clamped;
+        }
+
+        if (t.z < p.minHeight || t.z > p.maxHeight || r > p.maxReach)
+        {
+            if (!clamp)
+                return outsideBounds;
+
+            t.z = std::min(std::max(t.z, p.minHeight), p.maxHeight);
+            if (r > p.maxReach)
+            {
+                t.x *= p.maxReach / r;
+                t.y *= p.maxReach / r;
+                r = p.maxReach;
+            }
+            result = clamped;
+        }
+
+        if ((r > 0 && !within(p.joints[0], std::atan2(t.y, t.x))) || !within(p.joints[4], t.roll))
+            return outsideJointLimits;
+
+        if (!workspace<Arm>::get().reachable(r, t.z, t.pitch))
+            return outOfReach;
+
+        return result;
+    }
+}
+
+#endif // REACHABILITY_H
@@ -0,0 +1,300 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace recording
+{
+    enum kind
+    {
+        targetCommand = 1, // values are x, y, z, roll, pitch, time
+        handCommand = 2    // values are width, time
+    };
+
+    // A single command as it was sent.
+    struct command
+    {
+        int64_t stamp; // nanoseconds since the epoch
+        uint32_t seq;
+        uint8_t kind;
+        uint8_t pad[3];
+        float values[6];
+    };
+
+    // The start of every recording, count only covers commands which have been completely written.
+    struct header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t commandSize;
+        uint32_t pad;
+        uint64_t count;
+        uint8_t reserved[40];
+    };
+
+    const uint32_t fileMagic = 0x43524153; // "SARC"
+    const uint32_t fileVersion = 1;
+
+    // Appends commands to a memory mapped file, growing it a chunk at a time.
+    // An existing file is only appended to if it is a recording, anything else is left alone.
+    class recorder
+    {
+        public:
+            recorder(const std::string &path, size_t chunk = 4096) :
+                chunk(chunk),
+                fd(-1),
+                map(0),
+                capacity(0)
+            {
+                fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+                if (fd < 0)
+                {
+                    problem = std::strerror(errno);
+                    return;
+                }
+
+                struct stat info;
+                if (::fstat(fd, &info) != 0)
+                {
+                    problem = std::strerror(errno);
+                    close();
+                    return;
+                }
+
+                // read the header before mapping, growing the file would already change it
+                header existing;
+                std::memset(&existing, 0, sizeof(existing));
+                if (info.st_size > 0 && (info.st_size < (off_t)sizeof(header) ||
+                    ::pread(fd, &existing, sizeof(existing), 0) != (ssize_t)sizeof(existing) || !isRecording(existing)))
+                {
+                    problem = "it is not a recording";
+                    close();
+                    return;
+                }
+
+                if (!grow(info.st_size < (off_t)sizeof(header) ? 0 : commandsIn(info.st_size)))
+                {
+                    problem = std::strerror(errno);
+                    close();
+                    return;
+                }
+
+                header *h = head();
+                if (h->magic != fileMagic)
+                {
+                    std::memset(h, 0, sizeof(header));
+                    h->magic = fileMagic;
+                    h->version = fileVersion;
+                    h->commandSize = sizeof(command);
+                }
+                else if (h->version != fileVersion || h->commandSize != sizeof(command))
+                {
+                    // never append to a recording in another format
+                    problem = "it is a recording in another format";
+                    close();
+                }
+            }
+
+            ~recorder()
+            {
+                close();
+            }
+
+            bool isOpen() const
+            {
+                return map != 0;
+            }
+
+            uint64_t count() const
+            {
+                return map ? head()->count : 0;
+            }
+
+            // Why the file could not be opened, empty if it was.
+            const std::string &notice() const
+            {
+                return problem;
+            }
+
+            bool append(const command &c)
+            {
+                if (!map)
+                    return false;
+
+                header *h = head();
+                if (h->count >= capacity && !grow(capacity + chunk))
+                    return false;
+
+                std::memcpy(commands() + h->count, &c, sizeof(command));
+                // publish the command only once it has been copied in
+                __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            bool append(int64_t stamp, kind k, const float *values, int numValues)
+            {
+                command c;
+
+                std::memset(&c, 0, sizeof(c));
+                c.stamp = stamp;
+                c.seq = (uint32_t)count();
+                c.kind = k;
+                for (int i = 0; i < numValues && i < 6; i++)
+                    c.values[i] = values[i];
+
+                return append(c);
+            }
+
+            void close()
+            {
+                if (map)
+                {
+                    ::msync(map, bytesFor(capacity), MS_SYNC);
+                    ::munmap(map, bytesFor(capacity));
+                    map = 0;
+                }
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+
+        private:
+            recorder(const recorder &);
+            recorder &operator=(const recorder &);
+
+            // A recording, or a file left all zeros by a recorder stopped before it wrote the header.
+            static bool isRecording(const header &h)
+            {
+                header empty;
+
+                std::memset(&empty, 0, sizeof(empty));
+                return h.magic == fileMagic || std::memcmp(&h, &empty, sizeof(header)) == 0;
+            }
+
+            static size_t bytesFor(size_t commandCount)
+            {
+                return sizeof(header) + commandCount * sizeof(command);
+            }
+
+            static size_t commandsIn(size_t bytes)
+            {
+                return (bytes - sizeof(header)) / sizeof(command);
+            }
+
+            header *head() const
+            {
+                return reinterpret_cast<header *>(map);
+            }
+
+            command *commands() const
+            {
+                return reinterpret_cast<command *>(map + sizeof(header));
+            }
+
+            // Resizes the file to hold at least size commands and maps it again.
+            bool grow(size_t size)
+            {
+                if (size < chunk)
+                    size = chunk;
+
+                if (::ftruncate(fd, bytesFor(size)) != 0)
+                    return false;
+
+                void *next = map ? ::mremap(map, bytesFor(capacity), bytesFor(size), MREMAP_MAYMOVE)
+                                 : ::mmap(0, bytesFor(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (next == MAP_FAILED)
+                    return false;
+
+                map = static_cast<uint8_t *>(next);
+                capacity = size;
+                return true;
+            }
+
+            size_t chunk;
+            int fd;
+            uint8_t *map;
+            size_t capacity;
+            std::string problem;
+    };
+
+    // Maps a recording read only.
+    class player
+    {
+        public:
+            player(const std::string &path) :
+                map(0),
+                size(0),
+                numCommands(0)
+            {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                struct stat info;
+
+                if (fd < 0)
+                    return;
+
+                if (::fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(header))
+                {
+                    void *mapped = ::mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                    if (mapped != MAP_FAILED)
+                    {
+                        map = static_cast<const uint8_t *>(mapped);
+                        size = info.st_size;
+                    }
+                }
+                ::close(fd);
+
+                const header *h = reinterpret_cast<const header *>(map);
+                if (map && (h->magic != fileMagic || h->version != fileVersion || h->commandSize != sizeof(command)))
+                {
+                    ::munmap(const_cast<uint8_t *>(map), size);
+                    map = 0;
+                }
+
+                if (map)
+                {
+                    uint64_t fits = (size - sizeof(header)) / sizeof(command);
+                    numCommands = h->count < fits ? h->count : fits;
+                }
+            }
+
+            ~player()
+            {
+                if (map)
+                    ::munmap(const_cast<uint8_t *>(map), size);
+            }
+
+            bool isOpen() const
+            {
+                return map != 0;
+            }
+
+            uint64_t count() const
+            {
+                return numCommands;
+            }
+
+            const command &operator[](uint64_t i) const
+            {
+                return reinterpret_cast<const command *>(map + sizeof(header))[i];
+            }
+
+        private:
+            player(const player &);
+            player &operator=(const player &);
+
+            const uint8_t *map;
+            size_t size;
+            uint64_t numCommands;
+    };
+}
+
+#endif // RECORDING_H
@@ -0,0 +1,243 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "arm_profile.h"
+#include "hanoi.h"
+#include "payload.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Wait times learned from how long the arm actually takes.
+// The last samples of every segment kind are kept, the wait is a high percentile of them plus a
+// margin. Rotations are stored per eighth of a turn like the rotWait of the arm profile.
+// Every load is learned on its own, a load without enough samples keeps the profile wait.
+namespace timing
+{
+    const int numSegments = 4; // one for each hanoi::segment
+    const int historySize = 64;
+    const int minSamples = 5;  // the profile waits are used until there are this many samples
+    const int recentSamples = 16; // the samples compared against the baseline for drift
+    const float minTurn = 0.25; // shorter rotations (in eighths of a turn) are too noisy to learn from
+
+    struct history
+    {
+        uint32_t count; // samples taken, only the last historySize are kept
+        float samples[historySize];
+        float baseline; // the median time when the model was first calibrated, 0 until then
+    };
+
+    inline const char *name(hanoi::segment kind)
+    {
+        switch (kind)
+        {
+            case hanoi::rotateSegment: return "rotate";
+            case hanoi::lowerSegment:  return "lower";
+            case hanoi::gripSegment:   return "grip";
+            case hanoi::raiseSegment:  return "raise";
+        }
+
+        return "unknown";
+    }
+
+    class model
+    {
+        public:
+            // percentile is from 0 to 1, margin is added as a fraction of the percentile,
+            // drift is how much slower than the baseline the arm may get before a warning.
+            model(const arms::profile &p, float percentile = 0.95, float margin = 0.15, float drift = 0.25) :
+                p(p),
+                percentile(percentile),
+                margin(margin),
+                drift(drift)
+            {
+                std::memset(segments, 0, sizeof(segments));
+            }
+
+            // The time to wait for a segment with a load, scale is the rotation in eighths of a turn.
+            float wait(hanoi::segment kind, payload::load load, float scale = 1) const
+            {
+                const history &h = segments[kind][load];
+
+                if (h.count < (uint32_t)minSamples)
+                    return fallback(kind) * scale;
+
+                return quantile(h, historySize, percentile) * (1 + margin) * scale;
+            }
+
+            // Adds how long a segment took, returns true once the arm has become slower than its baseline.
+            bool add(hanoi::segment kind, payload::load load, float duration, float scale = 1)
+            {
+                if (kind == hanoi::rotateSegment && scale < minTurn)
+                    return false;
+
+                history &h = segments[kind][load];
+
+                h.samples[h.count % historySize] = duration / scale;
+                h.count++;
+
+                if (h.count < (uint32_t)recentSamples)
+                    return false;
+
+                if (h.baseline == 0)
+                    h.baseline = quantile(h, recentSamples, 0.5);
+
+                return quantile(h, recentSamples, 0.5) > h.baseline * (1 + drift);
+            }
+
+            const history &get(hanoi::segment kind, payload::load load) const
+            {
+                return segments[kind][load];
+            }
+
+            // Reads a saved model, false if there is none or it was learned on another arm.
+            bool load(const std::string &path)
+            {
+                FILE *file = std::fopen(path.c_str(), "rb");
+                header h;
+                history loaded[numSegments][payload::numLoads];
+                bool ok = false;
+
+                if (!file)
+                    return false;
+
+                if (std::fread(&h, sizeof(h), 1, file) == 1 && std::fread(loaded, sizeof(loaded), 1, file) == 1)
+                    ok = h.magic == magic && h.version == version && std::strncmp(h.arm, p.name, sizeof(h.arm)) == 0;
+
+                std::fclose(file);
+
+                if (ok)
+                    std::memcpy(segments, loaded, sizeof(segments));
+                return ok;
+            }
+
+            // Writes the model to a temporary file and moves it over the old one.
+            bool save(const std::string &path) const
+            {
+                std::string temp = path + ".tmp";
+                FILE *file = std::fopen(temp.c_str(), "wb");
+                header h;
+
+                if (!file)
+                    return false;
+
+                std::memset(&h, 0, sizeof(h));
+                h.magic = magic;
+                h.version = version;
+                std::strncpy(h.arm, p.name, sizeof(h.arm) - 1);
+
+                bool ok = std::fwrite(&h, sizeof(h), 1, file) == 1
+                       && std::fwrite(segments, sizeof(segments), 1, file) == 1;
+
+                ok = std::fclose(file) == 0 && ok;
+                return ok && std::rename(temp.c_str(), path.c_str()) == 0;
+            }
+
+        private:
+            static const uint32_t magic = 0x54434153; // "SACT"
+            static const uint32_t version = 2;
+
+            struct header
+            {
+                uint32_t magic;
+                uint32_t version;
+                char arm[16];
+            };
+
+            float fallback(hanoi::segment kind) const
+            {
+                switch (kind)
+                {
+                    case hanoi::rotateSegment: return p.rotWait;
+                    case hanoi::gripSegment:   return p.gripWait;
+                    default:                   return p.liftWait;
+                }
+            }
+
+            // The quantile q of the last (up to) last samples.
+            static float quantile(const history &h, int last, float q)
+            {
+                float sorted[historySize];
+                int n = std::min(h.count, (uint32_t)last);
+
+                for (int i = 0; i < n; i++)
+                    sorted[i] = h.samples[(h.count - 1 - i) % historySize];
+
+                int k = std::max(0, std::min(n - 1, (int)std::ceil(q * n) - 1));
+                std::nth_element(sorted, sorted + k, sorted + n);
+
+                return sorted[k];
+            }
+
+            arms::profile p;
+            float percentile;
+            float margin;
+            float drift;
+            history segments[numSegments][payload::numLoads];
+    };
+
+    // Tells when the arm has stopped moving from its joint states.
+    class settle
+    {
+        public:
+            settle(double settleTime = 0.25, float tolerance = 0.001) :
+                settleTime(settleTime),
+                tolerance(tolerance),
+                lastMotion(-1),
+                lastUpdate(-1)
+            {
+            }
+
+            void update(const std::vector<double> &positions, double now)
+            {
+                bool moved = false;
+
+                // the first joint states are where the arm starts, not a motion
+                if (positions.size() != last.size())
+                    last = positions;
+
+                for (size_t i = 0; i < positions.size() && !moved; i++)
+                    moved = std::fabs(positions[i] - last[i]) > tolerance;
+
+                // small changes are only noise, compare against the last real position
+                if (moved)
+                {
+                    last = positions;
+                    lastMotion = now;
+                }
+                lastUpdate = now;
+            }
+
+            // True once joint states are coming in.
+            bool live(double now) const
+            {
+                return lastUpdate >= 0 && now - lastUpdate < 1.0;
+            }
+
+            // True if the arm moved after start and has been still for the settle time since.
+            bool settledAfter(double start, double now) const
+            {
+                return lastMotion > start && now - lastMotion >= settleTime;
+            }
+
+            // When the arm last moved.
+            double motion() const
+            {
+                return lastMotion;
+            }
+
+        private:
+            double settleTime;
+            float tolerance;
+            double lastMotion;
+            double lastUpdate;
+            std::vector<double> last;
+    };
+}
+
+#endif // TIMING_H
@@ -0,0 +1,255 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "arm_profile.h"
+#include "reachability.h"
+#include "hanoi.h"
+#include "payload.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Time optimal duration of the motion between two waypoints (TOPP).
+// The gripper follows the segment in the workspace, rotations turn the base around at a steady
+// distance and height changes are straight up and down. The path is sampled, every sample is solved
+// for the joint angles of the arm, and the fastest speed along the path which keeps every joint in its
+// velocity and acceleration limits is found with a forward and a backward pass over the samples.
+// Only the duration is kept, the arm is sent the target with that time and plans its own motion.
+namespace topp
+{
+    const int numJoints = 5; // base, shoulder, elbow, pitch, roll
+    const int defaultSamples = 64;
+    const float flat = 1e-6; // joint motion per unit of path treated as none
+
+    struct pose
+    {
+        float q[numJoints];
+    };
+
+    // The joint angles of the arm for a gripper position, side picks elbow down (-1) or up (1).
+    inline bool inverse(const arms::profile &p, float x, float y, float z, float roll, float pitch,
+                        int side, pose &out)
+    {
+        float planar[3] = { 0, 0, 0 };
+
+        out.q[0] = hanoi::heading(x, y);
+        out.q[4] = roll;
+
+        bool ok = reach::inverse(p, std::sqrt(x * x + y * y), z, pitch, side, planar);
+
+        out.q[1] = planar[0];
+        out.q[2] = planar[1];
+        out.q[3] = planar[2];
+
+        return ok;
+    }
+
+    // Samples the path from one waypoint to the next into joint space.
+    // The elbow stays on one side for the whole path, if no side reaches every sample the joints
+    // are moved in a straight line between the two ends instead.
+    inline bool sample(const arms::profile &p, const hanoi::waypoint &from, const hanoi::waypoint &to,
+                       int samples, std::vector<pose> &out)
+    {
+        float r0 = std::sqrt(from.x * from.x + from.y * from.y);
+        float r1 = std::sqrt(to.x * to.x + to.y * to.y);
+        float h0 = hanoi::heading(from.x, from.y);
+        float h1 = hanoi::heading(to.x, to.y);
+
+        for (int side = -1; side <= 1; side += 2)
+        {
+            bool ok = true;
+
+            out.resize(samples + 1);
+            for (int i = 0; i <= samples && ok; i++)
+            {
+                float s = (float)i / samples;
+                float r = r0 + (r1 - r0) * s;
+                float h = h0 + (h1 - h0) * s;
+
+                ok = inverse(p, r * std::cos(h), r * std::sin(h), from.z + (to.z - from.z) * s,
+                             from.roll + (to.roll - from.roll) * s, from.pitch + (to.pitch - from.pitch) * s,
+                             side, out[i]);
+            }
+
+            if (ok)
+                return true;
+        }
+
+        pose a, b;
+        bool ok = (inverse(p, from.x, from.y, from.z, from.roll, from.pitch, -1, a) ||
+                   inverse(p, from.x, from.y, from.z, from.roll, from.pitch, 1, a)) &&
+                  (inverse(p, to.x, to.y, to.z, to.roll, to.pitch, -1, b) ||
+                   inverse(p, to.x, to.y, to.z, to.roll, to.pitch, 1, b));
+
+        if (!ok)
+            return false;
+
+        for (int i = 0; i <= samples; i++)
+            for (int j = 0; j < numJoints; j++)
+                out[i].q[j] = a.q[j] + (b.q[j] - a.q[j]) * i / samples;
+
+        return true;
+    }
+
+    // The joint limits of the arm scaled down for what it is carrying.
+    inline void limitsOf(const arms::profile &p, const payload::scaling &load, float velocity[numJoints],
+                         float acceleration[numJoints])
+    {
+        for (int j = 0; j < numJoints; j++)
+        {
+            velocity[j] = p.joints[j].velocity * load.speed;
+            acceleration[j] = p.joints[j].acceleration * load.acceleration;
+        }
+    }
+
+    // The range of path acceleration at a sample moving at the squared path speed v.
+    // Every joint has to stay within its acceleration limit, dq * sdd + ddq * v.
+    inline void accelerationRange(const float dq[numJoints], const float ddq[numJoints], const float a[numJoints],
+                                  float v, float &low, float &high)
+    {
+        low = -INFINITY;
+        high = INFINITY;
+
+        for (int j = 0; j < numJoints; j++)
+        {
+            if (std::fabs(dq[j]) < flat)
+            {
+                // the joint does not move along the path, only the curve can ask too much of it
+                if (std::fabs(ddq[j]) * v > a[j])
+                {
+                    low = INFINITY;
+                    high = -INFINITY;
+                }
+                continue;
+            }
+
+            float x = (-a[j] - ddq[j] * v) / dq[j];
+            float y = (a[j] - ddq[j] * v) / dq[j];
+
+            low = std::max(low, std::min(x, y));
+            high = std::min(high, std::max(x, y));
+        }
+    }
+
+    // The fastest time along a path of joint poses from standing to standing.
+    inline float parameterize(const std::vector<pose> &points, const float velocity[numJoints],
+                              const float acceleration[numJoints])
+    {
+        int n = points.size() - 1;
+        float total = 0;
+
+        if (n < 1)
+            return 0;
+
+        float ds = 1.0f / n;
+        std::vector<float> dq((n + 1) * numJoints), ddq((n + 1) * numJoints), limit(n + 1), v(n + 1);
+
+        // joint speed and curvature along the path
+        for (int i = 0; i <= n; i++)
+        {
+            int a = std::max(0, i - 1);
+            int b = std::min(n, i + 1);
+
+            for (int j = 0; j < numJoints; j++)
+            {
+                dq[i * numJoints + j] = (points[b].q[j] - points[a].q[j]) / ((b - a) * ds);
+                ddq[i * numJoints + j] = i == 0 || i == n ? 0 :
+                    (points[b].q[j] - 2 * points[i].q[j] + points[a].q[j]) / (ds * ds);
+            }
+        }
+
+        // the highest squared path speed at each sample from the velocity and acceleration limits
+        for (int i = 0; i <= n; i++)
+        {
+            const float *d = &dq[i * numJoints];
+            const float *dd = &ddq[i * numJoints];
+            float top = INFINITY;
+            float low, high;
+
+            for (int j = 0; j < numJoints; j++)
+                if (std::fabs(d[j]) >= flat)
+                    top = std::min(top, (velocity[j] / d[j]) * (velocity[j] / d[j]));
+
+            if (std::isinf(top))
+            {
+                // nothing moves here, only the curve limits the speed
+                top = 1e6;
+            }
+
+            accelerationRange(d, dd, acceleration, top, low, high);
+            if (low > high)
+            {
+                // find where the acceleration range closes, it is open when standing
+                float bottom = 0;
+                for (int k = 0; k < 32; k++)
+                {
+                    float middle = (bottom + top) / 2;
+
+                    accelerationRange(d, dd, acceleration, middle, low, high);
+                    if (low <= high)
+                        bottom = middle;
+                    else
+                        top = middle;
+                }
+                top = bottom;
+            }
+
+            limit[i] = top;
+        }
+
+        // speed up as hard as allowed from the start
+        v[0] = 0;
+        for (int i = 0; i < n; i++)
+        {
+            float low, high;
+
+            accelerationRange(&dq[i * numJoints], &ddq[i * numJoints], acceleration, v[i], low, high);
+            v[i + 1] = std::max(0.0f, std::min(limit[i + 1], v[i] + 2 * ds * high));
+        }
+
+        // and slow down as hard as allowed to stop at the end
+        v[n] = 0;
+        for (int i = n; i > 0; i--)
+        {
+            float low, high;
+
+            accelerationRange(&dq[i * numJoints], &ddq[i * numJoints], acceleration, v[i], low, high);
+            v[i - 1] = std::min(v[i - 1], std::max(0.0f, v[i] - 2 * ds * low));
+        }
+
+        // the time for each step at the average of the path speeds at its ends
+        for (int i = 0; i < n; i++)
+        {
+            float speed = std::sqrt(v[i]) + std::sqrt(v[i + 1]);
+
+            total += speed > 0 ? 2 * ds / speed : 0;
+        }
+
+        return total;
+    }
+
+    // The time optimal duration of the motion of an arm from one waypoint to the next with the load in
+    // the gripper, 0 if the arm does not move or cannot follow the path.
+    inline float duration(const arms::profile &p, const hanoi::waypoint &from, const hanoi::waypoint &to,
+                          const payload::scaling &load, int samples = defaultSamples)
+    {
+        std::vector<pose> points;
+        float velocity[numJoints], acceleration[numJoints];
+
+        if (!sample(p, from, to, samples, points))
+            return 0;
+
+        limitsOf(p, load, velocity, acceleration);
+        return parameterize(points, velocity, acceleration);
+    }
+
+    // The same with the load taken from the block in the gripper at the waypoint.
+    inline float duration(const arms::profile &p, const hanoi::waypoint &from, const hanoi::waypoint &to,
+                          int numBlocks)
+    {
+        return duration(p, from, to, payload::profiles[payload::classOf(to.block, numBlocks)]);
+    }
+}
+
+#endif // TRAJECTORY_H
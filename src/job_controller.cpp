@@ -0,0 +1,230 @@
+// runs a stream of pick and place jobs, reordering them to cut down on travel
+#include "helpers/config.h"
+#include "helpers/arm_profile.h"
+#include "helpers/reachability.h"
+#include "helpers/hanoi.h"
+#include "helpers/job_queue.h"
+
+#include <ros/ros.h>
+#include <sac_msgs/Target.h>
+#include <sac_msgs/HandPos.h>
+#include <std_msgs/Float32MultiArray.h>
+#include <std_msgs/Int32.h>
+#include <std_msgs/Int32MultiArray.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace job
+{
+    // constants
+    const char *nodeName = "job_controller";
+    const float pi = 3.1415926535898;
+    const int jobFields = 8; // id, pick x, y, z, place x, y, z, grip
+    const float openGrip = 0.065;
+    const float raised = 0.200;
+
+    // the transit height and gripper pose for every job
+    const hanoi::layout transit = {
+        { { 0, 0 }, { 0, 0 }, { 0, 0 } },
+        { 0 },
+        { 0 },
+        openGrip, raised, 0, 0, 0.000000, pi / 2
+    };
+
+    // variables
+    bool enabled = true;
+    jobs::queue *pending;
+    bool (*accept)(jobs::job &j); // checks a job against the arm
+    int done = 0;
+    float heading = NAN; // the base rotation of the last target, NAN if it is not known
+
+    // publishers
+    ros::Publisher targets;
+    ros::Publisher hand;
+    ros::Publisher progress;
+    ros::Publisher finished;
+}
+
+void move(float x, float y, float z,
+	  float roll, float pitch, float hand)
+{
+    // Arm movement
+    sac_msgs::Target targetMsg;
+
+    targetMsg.x = x;
+    targetMsg.y = y;
+    targetMsg.z = z;
+    targetMsg.pitch = pitch;
+    targetMsg.roll = roll;
+    job::targets.publish(targetMsg);
+
+    // Hand movement
+    sac_msgs::HandPos handMsg;
+
+    handMsg.width = hand;
+    job::hand.publish(handMsg);
+}
+
+void report()
+{
+    std_msgs::Int32MultiArray progressMsg;
+
+    progressMsg.data.push_back(job::done);
+    progressMsg.data.push_back(job::done + job::pending->size());
+    job::progress.publish(progressMsg);
+}
+
+// Jobs are sent as [id, pick x, y, z, place x, y, z, grip].
+void jobCallback(const std_msgs::Float32MultiArray::ConstPtr& msg)
+{
+    if (msg->data.size() != job::jobFields)
+    {
+        ROS_WARN("Ignoring a job with %zu fields instead of %d.", msg->data.size(), job::jobFields);
+        return;
+    }
+
+    if (!jobs::exactId(msg->data[0]))
+    {
+        ROS_WARN("Ignoring a job with the id %.0f, ids have to be whole numbers below %.0f.", msg->data[0],
+                 jobs::maxId);
+        return;
+    }
+
+    jobs::job j;
+    j.id = (uint32_t)msg->data[0];
+    j.pick = { msg->data[1], msg->data[2], msg->data[3] };
+    j.place = { msg->data[4], msg->data[5], msg->data[6] };
+    j.grip = msg->data[7];
+    j.arrival = ros::Time::now().toSec();
+
+    if (job::accept(j))
+    {
+        job::pending->push(j);
+        report();
+    }
+}
+
+// Checks every waypoint of a job against the arm's workspace.
+template <class Arm>
+bool acceptable(jobs::job &j)
+{
+    std::vector<hanoi::waypoint> path;
+
+    jobs::expand(j, job::transit, path);
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        reach::target t = { path[i].x, path[i].y, path[i].z, path[i].roll, path[i].pitch, path[i].hand };
+        reach::status result = reach::check<Arm>(t, false);
+
+        if (result != reach::reachable)
+        {
+            ROS_WARN("Rejecting job %u, (%f, %f, %f) %s.", j.id, t.x, t.y, t.z, reach::reason(result));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The time to wait for the arm to reach a waypoint.
+template <class Arm>
+float waitFor(const hanoi::waypoint &w)
+{
+    switch (w.kind)
+    {
+        case hanoi::rotateSegment:
+        {
+            // rotWait covers an eighth of a turn, assume the longest turn if the start is unknown
+            float turn = std::isnan(job::heading) ? job::pi / 2
+                                                  : std::fabs(hanoi::heading(w.x, w.y) - job::heading);
+
+            return Arm::table().rotWait * turn / (job::pi / 4);
+        }
+        case hanoi::gripSegment:
+            return Arm::table().gripWait;
+        default:
+            return Arm::table().liftWait;
+    }
+}
+
+template <class Arm>
+void run(double window, double maxLatency, float linearSpeed)
+{
+    jobs::queue pending(jobs::travel { (float)Arm::table().rotWait, linearSpeed }, window, maxLatency);
+    std::vector<jobs::job> batch;
+    std::vector<hanoi::waypoint> path;
+    jobs::location at = { 0, 0, job::raised };
+
+    job::pending = &pending;
+    job::accept = acceptable<Arm>;
+
+    while (job::enabled && ros::ok())
+    {
+        ros::spinOnce();
+
+        pending.next(at, ros::Time::now().toSec(), batch);
+        if (batch.empty())
+        {
+            ros::Duration(0.1).sleep();
+            continue;
+        }
+
+        for (size_t i = 0; i < batch.size() && ros::ok(); i++)
+        {
+            path.clear();
+            jobs::expand(batch[i], job::transit, path);
+
+            for (size_t k = 0; k < path.size(); k++)
+            {
+                move(path[k].x, path[k].y, path[k].z, path[k].roll, path[k].pitch, path[k].hand);
+                ros::Duration(waitFor<Arm>(path[k])).sleep();
+                job::heading = hanoi::heading(path[k].x, path[k].y);
+            }
+            at = batch[i].place;
+
+            std_msgs::Int32 finishedMsg;
+            finishedMsg.data = batch[i].id;
+            job::finished.publish(finishedMsg);
+            job::done++;
+            report();
+
+            // take in new jobs while working through the batch
+            ros::spinOnce();
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, job::nodeName);
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    std::string arm;
+    double window, maxLatency, linearSpeed;
+
+    pnh.param<std::string>("arm", arm, arms::defaultArm::table().name);
+    pnh.param("window", window, 30.0); // seconds a later job may jump ahead of an earlier one
+    pnh.param("max_latency", maxLatency, 120.0); // seconds before a job is run ahead of the rest
+    pnh.param("linear_speed", linearSpeed, 0.05); // m/s, used to estimate travel
+
+    // relative names so a controller can run in each arm's namespace
+    job::targets = nh.advertise<sac_msgs::Target>("moveto", 1000);
+    job::hand = nh.advertise<sac_msgs::HandPos>("handDriver", 1000);
+    job::progress = nh.advertise<std_msgs::Int32MultiArray>("jobProgress", 10);
+    job::finished = nh.advertise<std_msgs::Int32>("jobDone", 100);
+    ros::Subscriber sub = nh.subscribe("jobs", 1000, jobCallback);
+
+    bool known = arms::withArm(arm, [&](auto profile)
+    {
+        run<decltype(profile)>(window, maxLatency, linearSpeed);
+    });
+
+    if (!known)
+    {
+        ROS_ERROR("Unknown arm %s.", arm.c_str());
+        return 1;
+    }
+}
@@ -0,0 +1,42 @@
+// compiles a motion program to the bytecode run by the program controller
+// run "rosrun sac_controllers motion_compiler program.motion program.mbc"
+#include "helpers/motion.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::fprintf(stderr, "usage: %s program.motion program.mbc\n", argv[0]);
+        return 2;
+    }
+
+    std::ifstream in(argv[1]);
+    std::stringstream source;
+
+    if (!in)
+    {
+        std::fprintf(stderr, "%s: could not be read\n", argv[1]);
+        return 1;
+    }
+    source << in.rdbuf();
+
+    motion::compiler compiler;
+    std::string error;
+
+    if (!compiler.compile(source.str(), error))
+    {
+        std::fprintf(stderr, "%s: %s\n", argv[1], error.c_str());
+        return 1;
+    }
+
+    if (!compiler.write(argv[2]))
+    {
+        std::fprintf(stderr, "%s: could not be written\n", argv[2]);
+        return 1;
+    }
+}
@@ -0,0 +1,229 @@
+// runs a compiled motion program, see helpers/motion.h for the program format
+#include "helpers/config.h"
+#include "helpers/arm_profile.h"
+#include "helpers/reachability.h"
+#include "helpers/motion.h"
+
+#include <ros/ros.h>
+#include <sac_msgs/Target.h>
+#include <sac_msgs/HandPos.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// where the package build puts the compiled programs
+#ifndef DEVEL_PROGRAMS
+#define DEVEL_PROGRAMS ""
+#endif
+#ifndef INSTALL_PROGRAMS
+#define INSTALL_PROGRAMS ""
+#endif
+
+namespace program
+{
+    // constants
+    const char *nodeName = "program_controller";
+    const float pi = 3.1415926535898;
+
+    // variables
+    bool enabled = true;
+    bool clampTargets = false; // clamp targets outside of the workspace instead of stopping
+
+    // publishers
+    ros::Publisher targets;
+    ros::Publisher hand;
+}
+
+// Carries out the actions of the program on an arm.
+template <class Arm>
+class armSink
+{
+    public:
+        armSink() :
+            heading(NAN),
+            moved(false),
+            gripped(false)
+        {
+        }
+
+        void move(const hanoi::waypoint &w)
+        {
+            reach::target t = { w.x, w.y, w.z, w.roll, w.pitch, w.hand };
+            reach::status result = reach::check<Arm>(t, program::clampTargets);
+
+            if (result != reach::reachable && result != reach::clamped)
+            {
+                ROS_ERROR("Stopping before (%f, %f, %f), %s.", w.x, w.y, w.z, reach::reason(result));
+                program::enabled = false;
+                return;
+            }
+
+            if (result == reach::clamped)
+                ROS_WARN("(%f, %f, %f) was %s.", w.x, w.y, w.z, reach::reason(result));
+
+            sac_msgs::Target targetMsg;
+
+            targetMsg.x = t.x;
+            targetMsg.y = t.y;
+            targetMsg.z = t.z;
+            targetMsg.pitch = t.pitch;
+            targetMsg.roll = t.roll;
+            program::targets.publish(targetMsg);
+
+            sac_msgs::HandPos handMsg;
+
+            handMsg.width = t.hand;
+            program::hand.publish(handMsg);
+
+            last = w;
+            moved = true;
+        }
+
+        void grip(float width)
+        {
+            sac_msgs::HandPos handMsg;
+
+            handMsg.width = width;
+            program::hand.publish(handMsg);
+
+            gripped = true;
+        }
+
+        // Waits the profile time for the last move and grip, they run at the same time.
+        void wait()
+        {
+            float time = gripped ? Arm::table().gripWait : 0;
+
+            if (moved && last.kind == hanoi::rotateSegment)
+            {
+                // rotWait covers an eighth of a turn, assume the longest turn if the start is unknown
+                float turn = std::isnan(heading) ? program::pi / 2
+                                                 : std::fabs(hanoi::heading(last.x, last.y) - heading);
+
+                time = std::max(time, Arm::table().rotWait * turn / (program::pi / 4));
+            }
+            else if (moved)
+                time = std::max(time, (float)Arm::table().liftWait);
+
+            if (time > 0)
+                ros::Duration(time).sleep();
+
+            if (moved)
+                heading = hanoi::heading(last.x, last.y);
+            moved = false;
+            gripped = false;
+        }
+
+        void sleep(float seconds)
+        {
+            if (seconds > 0)
+                ros::Duration(seconds).sleep();
+        }
+
+        bool ok()
+        {
+            ros::spinOnce();
+            return program::enabled && ros::ok();
+        }
+
+    private:
+        hanoi::waypoint last; // the last target sent
+        float heading;        // the base rotation of the last target, NAN if it is not known
+        bool moved;           // a target has been sent since the last wait
+        bool gripped;         // the hand has been sent since the last wait
+};
+
+// ~program is a path to a compiled program, or the name of one compiled with the package.
+std::string locate(const std::string &program)
+{
+    const char *folders[] = { DEVEL_PROGRAMS, INSTALL_PROGRAMS };
+
+    if (program.find('/') != std::string::npos)
+        return program;
+
+    for (const char *folder : folders)
+    {
+        std::string path = std::string(folder) + "/" + program + ".mbc";
+
+        if (folder[0] && ::access(path.c_str(), R_OK) == 0)
+            return path;
+    }
+
+    return program;
+}
+
+// Sets the params and tables of the program from ~params/<name>.
+void overrideParams(ros::NodeHandle &pnh, const motion::image &image, motion::machine &machine)
+{
+    for (int i = 0; i < image.head().numParams; i++)
+    {
+        const motion::symbol &s = image.symbols()[i];
+        std::string name = std::string("params/") + s.name;
+        std::vector<float> values;
+        double value;
+
+        if (s.count == 1 && pnh.getParam(name, value))
+            values.push_back(value);
+        else if (!pnh.getParam(name, values))
+            continue;
+
+        if (machine.set(s.name, values.data(), values.size()))
+            ROS_INFO("Set %s from the params.", s.name);
+        else
+            ROS_WARN("Ignoring ~%s, it needs %u values.", name.c_str(), s.count);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, program::nodeName);
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    std::string path, arm;
+
+    pnh.param<std::string>("program", path, "");
+    pnh.param<std::string>("arm", arm, arms::defaultArm::table().name);
+    pnh.param("clamp_targets", program::clampTargets, false);
+
+    path = locate(path);
+    motion::image image(path);
+
+    if (!image.isValid())
+    {
+        ROS_ERROR("%s is not a compiled motion program.", path.c_str());
+        return 1;
+    }
+
+    motion::machine machine(image);
+    overrideParams(pnh, image, machine);
+
+    program::targets = nh.advertise<sac_msgs::Target>("moveto", 1000);
+    program::hand = nh.advertise<sac_msgs::HandPos>("handDriver", 1000);
+
+    // only wait for the arm to be listening
+    for (int i = 0; i < 150 && program::targets.getNumSubscribers() == 0 && ros::ok(); i++)
+        ros::Duration(0.1).sleep();
+
+    bool finished = true;
+    bool known = arms::withArm(arm, [&](auto profile)
+    {
+        armSink<decltype(profile)> sink;
+        finished = machine.run(sink);
+    });
+
+    if (!known)
+    {
+        ROS_ERROR("Unknown arm %s.", arm.c_str());
+        return 1;
+    }
+
+    if (!finished)
+    {
+        ROS_ERROR("%s read past the end of a table.", path.c_str());
+        return 1;
+    }
+}
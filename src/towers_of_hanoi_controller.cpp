@@ -2,6 +2,19 @@
 // callback for the menu selector int32
 #include "helpers/config.h"
 #include "helpers/selector.h"
+#include "helpers/arm_profile.h"
+#include "helpers/reachability.h"
+#include "helpers/hanoi.h"
+#include "helpers/checkpoint.h"
+#include "helpers/timing.h"
+#include "helpers/plan_search.h"
+#include "helpers/payload.h"
+#include "helpers/trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
 
 #include <ros/ros.h>
 #include <geometry_msgs/Twist.h>
@@ -10,6 +23,8 @@
 #include <sac_msgs/Target.h>
 #include <sac_msgs/Path.h>
 #include <sac_msgs/HandPos.h>
+#include <std_msgs/Int32MultiArray.h>
+#include <sensor_msgs/JointState.h>
 
 namespace towers
 {
@@ -18,11 +33,11 @@ namespace towers
     const int controllerNum = 1;
     const float pi = 3.1415926535898;
     const char *planningGroup = "arm";
-    
-    // wait times (if running on a vm these may need to be increased.)
-    const int gripWait = 10; // time for the gripper to open and close.
-    const int rotWait = 9; // time for the gripper to rotate between targets
-    const int liftWait = 5; // time for the gripper to raise and lower
+    const int numBlocks = 3;
+    const int startupWait = 15; // time for the rest of the system to come up
+    const int showWait = 10; // time to show off the finished tower
+    // the arm specific wait times are in helpers/arm_profile.h, they are only used until the
+    // arm's own times have been learned
 
     // grip widths
     const float block2Grip = 0.018;
@@ -38,17 +53,36 @@ namespace towers
     const float lift = 0.005;
     const float drop = 0.010;
 
+    // the pegs and blocks (the blocks start on peg 0)
+    const hanoi::layout pegLayout = {
+        { { 0.000000, 0.336000 }, { 0.237558, 0.237558 }, { 0.336000, 0.000000 } },
+        { block0, block1, block2 },
+        { block0Grip, block1Grip, block2Grip },
+        openGrip, raised, lift, drop, 0.000000, pi / 2
+    };
+
     // variables
     bool enabled = true; // change this to false later if this is not the default node.
     selector *sel;
+    hanoi::waypoint last; // the last target sent
+    bool known = false; // false until the arm is known to be at the last target
+    search::references full; // the lift and grip the wait times are for
+    bool clampTargets = false; // clamp targets outside of the workspace instead of stopping
+    timing::model *timings; // the learned wait times for the arm
+    timing::settle *feedback; // when the arm last moved
+    std::string timingPath;
+    std::string planCache;
+    int goal = -1; // the peg to build the tower on, -1 lets the plan search pick
 
     // publishers
     ros::Publisher targets;
     ros::Publisher hand;
+    ros::Publisher progress;
 }
 
+// time is how long the arm has for the motion and handTime how long the hand has, 0 leaves it to the planner.
 void move(float x, float y, float z, 
-	  float roll, float pitch, float hand)
+	  float roll, float pitch, float hand, float time = 0, float handTime = 0)
 {
     // Arm movement
     sac_msgs::Target targetMsg;
@@ -58,728 +92,384 @@ void move(float x, float y, float z,
     targetMsg.z = z;
     targetMsg.pitch = pitch;
     targetMsg.roll = roll;
+    targetMsg.time = time;
     towers::targets.publish(targetMsg);
     
     // Hand movement
     sac_msgs::HandPos handMsg;
     
     handMsg.width = hand;
+    handMsg.time = handTime;
     towers::hand.publish(handMsg);
 }
 
-void move0start()
+// Reports how many moves of the current cycle have been completed.
+void report(int done, int total)
 {
-	// blocks
-    //     2
-	//     1
-    //     0
-    // turn to move over the block 2
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait * 2);
-    
-    // lower onto the block 2
-    move(0.000000, 0.336000, towers::block0 + towers::block1 + towers::lift, // 0.065000, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.000000, 0.336000, towers::block0 + towers::block1 + towers::lift, //0.065000, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos 2
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait * 2);
-    
-    // lower the block
-    move(0.336000, 0.000000, towers::drop, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.336000, 0.000000, towers::drop, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//     1
-    // 2   0
-}
+    std_msgs::Int32MultiArray progressMsg;
 
-void move0()
-{
-	// blocks
-    //     2
-	//     1
-    //     0
-    // lift up the block
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos 2
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait * 2);
-    
-    // lower the block
-    move(0.336000, 0.000000, towers::drop, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.336000, 0.000000, towers::drop, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//     1
-    // 2   0
+    progressMsg.data.push_back(done);
+    progressMsg.data.push_back(total);
+    towers::progress.publish(progressMsg);
 }
 
-void move1()
+void jointCallback(const sensor_msgs::JointState::ConstPtr& msg)
 {
-	// blocks
-    //      
-	//     1
-    // 2   0
-    // turn to move over the block 1
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait * 2);
-    
-    // lower onto the block 1
-    move(0.000000, 0.336000, towers::block0 + towers::lift, // 0.042000, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.000000, 0.336000, towers::block0 + towers::lift, // 0.042000,
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos2
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.237558, 0.237558, towers::drop, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.237558, 0.237558, towers::drop, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//      
-    // 2 1 0
+    // the time it came in, so it compares with when the target was sent
+    towers::feedback->update(msg->position, ros::Time::now().toSec());
 }
 
-void move2()
+// How much of a full segment the motion to a waypoint is (in eighths of a turn for rotations).
+float scaleOf(const hanoi::waypoint &w)
 {
-	// blocks
-    //      
-	//      
-    // 2 1 0
-    // turn to move over the block 2
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 2
-    move(0.336000, 0.000000, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.336000, 0.000000, towers:: lift, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.237558, 0.237558, towers::block1 + towers::drop, // 0.040000,
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.237558, 0.237558, towers::block1 + towers::drop, // 0.040000,
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-        //      
-	//   2  
-        //   1 0
-}
+    // assume the longest turn and a full lift or grip if the start is unknown
+    if (!towers::known)
+        return w.kind == hanoi::rotateSegment ? 2 : 1;
 
-void move3()
-{
-	// blocks
-        //      
-	//   2  
-        //   1 0
-    // turn to move over the block 0
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 0
-    move(0.000000, 0.336000, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.000000, 0.336000, towers::lift, 
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::rotWait * 2);
-    
-    // lower the block
-    move(0.336000, 0.000000, 0.000000, 
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.336000, 0.000000, towers::drop, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-        //      
-	//   2  
-        // 0 1  
+    return search::scale(towers::last, w, towers::full);
 }
 
-void move4()
+// Waits for the arm to reach a waypoint and learns how long it took.
+// Without joint states this is the learned (or profile) wait, with them the wait ends once the arm
+// settles. Segments where nothing moved (like a gripper missing from the joint states) are not learned.
+// The wait is never shorter than the time the arm was given for the motion.
+void waitFor(const hanoi::waypoint &w, payload::load load, float scale, float time, bool learn)
 {
-	// blocks
-        //      
-	//   2  
-        // 0 1  
-    // turn to move over the block 2
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 2
-    move(0.237558, 0.237558, towers::block1 + towers::lift, // 0.040000, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.237558, 0.237558, towers::block1 + towers::lift, // 0.040000, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.000000, 0.336000, towers::drop, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.000000, 0.336000, towers::drop, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//      
-    // 0 1 2
-}
+    float wait = std::max(time, towers::timings->wait(w.kind, load, scale));
+    double start = ros::Time::now().toSec();
+    double now = start;
 
-void move5()
-{
-	// blocks
-    //      
-	//      
-    // 0 1 2
-    // turn to move over the block 0
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 0
-    move(0.237558, 0.237558, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.237558, 0.237558, towers::lift, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.336000, 0.000000, towers::block0 + towers::drop, // 0.050000, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.336000, 0.000000, towers::block0 + towers::drop, // 0.050000, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	// 1    
-    // 0   2
+    while (ros::ok())
+    {
+        usleep(10000);
+        ros::spinOnce();
+        now = ros::Time::now().toSec();
+
+        if (!towers::feedback->live(now) || towers::feedback->motion() <= start)
+        {
+            if (now - start >= wait)
+                return;
+            continue;
+        }
+
+        if (towers::feedback->settledAfter(start, now))
+            break;
+
+        // still moving long after it should have stopped, learn from how long it has taken so far
+        if (now - start >= 2 * wait)
+            break;
+    }
+
+    if (!learn || !ros::ok())
+        return;
+
+    float taken = std::min(now, towers::feedback->motion()) - start;
+
+    if (towers::timings->add(w.kind, load, taken, scale))
+        ROS_WARN_THROTTLE(60, "The %s %s segments are getting slower, now %.2f s where %.2f s was calibrated.",
+                          payload::name(load), timing::name(w.kind), taken / scale,
+                          towers::timings->get(w.kind, load).baseline);
 }
 
-void move6()
+// Moves to a waypoint and waits for the arm to get there, false if it did not get there.
+// Targets the arm cannot reach are never sent, the controller stops instead.
+template <class Arm>
+bool go(const hanoi::waypoint &w)
 {
-	// blocks
-    //      
-	// 1    
-    // 0   2
-    // turn to move over the block 0
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait * 2);
-    
-    // lower onto the block 0
-    move(0.000000, 0.336000, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.000000, 0.336000, towers::lift, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait * 2);
-    
-    // lower the block
-    move(0.336000, 0.000000, towers::block0 + towers::block1 + towers::lift, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-	// blocks
-    // 2    
-	// 1    
-    // 0    
+    reach::target t = { w.x, w.y, w.z, w.roll, w.pitch, w.hand };
+    reach::status result = reach::check<Arm>(t, towers::clampTargets);
+
+    if (result != reach::reachable && result != reach::clamped)
+    {
+        ROS_ERROR("Stopping before (%f, %f, %f), %s.", w.x, w.y, w.z, reach::reason(result));
+        towers::enabled = false;
+        return false;
+    }
+
+    if (result == reach::clamped)
+        ROS_WARN("(%f, %f, %f) was %s.", w.x, w.y, w.z, reach::reason(result));
+
+    // every load has its own learned times, until then it waits the profile time
+    payload::load load = payload::loadOf(w, towers::numBlocks);
+    float scale = scaleOf(w);
+    float wait = towers::timings->wait(w.kind, load, scale);
+    float time = wait;
+
+    // the arm gets the time optimal duration for its joint limits, the gripper keeps the learned time
+    if (towers::known && w.kind != hanoi::gripSegment)
+    {
+        float optimal = topp::duration(Arm::table(), towers::last, w, towers::numBlocks);
+
+        if (optimal > 0)
+            time = optimal;
+    }
+
+    move(t.x, t.y, t.z, t.roll, t.pitch, t.hand, time, wait);
+    waitFor(w, load, scale, time, towers::known);
+
+    // shut down part way through the motion, where the arm is now is not known
+    if (!ros::ok())
+    {
+        towers::known = false;
+        return false;
+    }
+
+    towers::last = w;
+    towers::known = true;
+    return true;
 }
 
-void move7()
+// Checks every waypoint of the plan against the arm before anything is moved.
+template <class Arm>
+bool reachable(const search::plan &plan, hanoi::world world)
 {
-	// blocks
-    // 2     
-	// 1    
-    // 0   
-    // lift up the block
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait * 2);
-    
-    // lower the block
-    move(0.000000, 0.336000, towers::drop, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.000000, 0.336000, towers::drop, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    // 
-	// 1    
-    // 0   2
+    std::vector<hanoi::waypoint> path;
+
+    for (size_t i = 0; i < plan.moves.size(); i++)
+    {
+        path.clear();
+        search::expand(plan, i, world, towers::pegLayout, path);
+        world.apply(plan.moves[i]);
+
+        for (size_t j = 0; j < path.size(); j++)
+        {
+            reach::target t = { path[j].x, path[j].y, path[j].z, path[j].roll, path[j].pitch, path[j].hand };
+            reach::status result = reach::check<Arm>(t, towers::clampTargets);
+
+            if (result != reach::reachable && result != reach::clamped)
+            {
+                ROS_ERROR("Move %zu can not be done by the %s, (%f, %f, %f) %s.", i, Arm::table().name,
+                          path[j].x, path[j].y, path[j].z, reach::reason(result));
+                return false;
+            }
+        }
+    }
+
+    return true;
 }
 
-void move8()
+// True if the arm can be sent to the waypoint.
+template <class Arm>
+bool allowed(const hanoi::waypoint &w)
 {
-	// blocks
-    //      
-	// 1    
-    // 0   2
-    // turn to move over the block 1
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait * 2);
-    
-    // lower onto the block 1
-    move(0.336000, 0.000000, towers::block0 + towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.336000, 0.000000, towers::block0 + towers::lift, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.237558, 0.237558, towers::drop,
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.237558, 0.237558, towers::drop,
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//      
-    // 0 1 2
+    reach::target t = { w.x, w.y, w.z, w.roll, w.pitch, w.hand };
+    reach::status result = reach::check<Arm>(t, towers::clampTargets);
+
+    return result == reach::reachable || result == reach::clamped;
 }
 
-void move9()
+// The time of a full segment of each kind with each load, what the plans are scored with.
+void unitsOf(const timing::model &timings, float unit[][payload::numLoads])
 {
-	// blocks
-    //      
-	//      
-    // 0 1 2
-    // turn to move over the block 2
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 2
-    move(0.000000, 0.336000, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.000000, 0.336000, towers::block0 + towers::lift, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.237558, 0.237558, towers::block1 + towers::drop,
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.237558, 0.237558, towers::block1 + towers::drop,
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//   2  
-    // 0 1  
+    for (int i = 0; i < timing::numSegments; i++)
+        for (int j = 0; j < payload::numLoads; j++)
+            unit[i][j] = timings.wait((hanoi::segment)i, (payload::load)j);
 }
 
-void move10()
+// Picks the plan with the shortest predicted cycle, searching only for setups which are not cached.
+template <class Arm>
+search::plan choose(const timing::model &timings)
 {
-	// blocks
-    //      
-	//   2  
-    // 0 1  
-    // turn to move over the block 0
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 0
-    move(0.336000, 0.000000, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.336000, 0.000000, towers::block0 + towers::lift, 
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::rotWait * 2);
-    
-    // lower the block
-    move(0.000000, 0.336000, towers::drop,
-         0.000000, towers::pi / 2, towers::block0Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.000000, 0.336000, towers::drop,
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//   2  
-    //   1 0
+    const int start = 0; // the blocks start on the first peg
+    float unit[timing::numSegments][payload::numLoads];
+
+    unitsOf(timings, unit);
+
+    search::cache cached(towers::planCache);
+    uint64_t key = search::keyOf(Arm::table().name, towers::numBlocks, start, towers::goal, towers::pegLayout, unit);
+    std::vector<search::options> candidates;
+    search::options opt;
+
+    if (cached.find(key, opt))
+    {
+        candidates.push_back(opt);
+        ROS_INFO("Using the cached plan from %s.", towers::planCache.c_str());
+    }
+    else
+        candidates = search::candidates(start, towers::goal, towers::raised);
+
+    search::plan best = search::best(candidates, towers::numBlocks, start, towers::pegLayout, unit, allowed<Arm>);
+
+    if (std::isinf(best.cost))
+        return best;
+
+    ROS_INFO("Building the tower on peg %d, transit %s, gripper %s, %.0f s a cycle.", best.opt.goal,
+             best.opt.raised > 0 ? "at a fixed height" : "just over the stacks",
+             best.opt.clearance > 0 ? "opened just past the block" : "opened fully", best.cost);
+
+    if (candidates.size() > 1 && !cached.store(key, best.opt))
+        ROS_WARN("Could not save the plan to %s.", towers::planCache.c_str());
+
+    return best;
 }
 
-void move11()
+// Builds the plan a checkpoint was written for again, the cost is INFINITY if it can not be run.
+template <class Arm>
+search::plan rebuild(const search::options &opt, const timing::model &timings)
 {
-	// blocks
-    //      
-	//   2  
-    //   1 0
-    // turn to move over the block 2
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 2
-    move(0.237558, 0.237558, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.237558, 0.237558, towers::block1 + towers::lift, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.336000, 0.000000, towers::block1 + towers::drop,
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.336000, 0.000000, towers::block1 + towers::drop,
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//      
-    // 2 1 0
+    float unit[timing::numSegments][payload::numLoads];
+    search::plan p = search::build(opt, towers::numBlocks, 0, towers::pegLayout);
+
+    // the blocks start on peg 0, and a goal set with ~goal has to be kept
+    unitsOf(timings, unit);
+    if (opt.goal <= 0 || opt.goal >= hanoi::numPegs || (towers::goal >= 0 && opt.goal != towers::goal))
+        p.cost = INFINITY;
+    else if (p.cost == 0)
+        p.cost = search::cycleTime(p, towers::numBlocks, 0, towers::pegLayout, unit, allowed<Arm>);
+
+    return p;
 }
 
-void move12()
+// Restores the world model and plan position from the last checkpoint record.
+bool resume(const checkpoint::record &last, const std::vector<hanoi::move> &plan,
+            hanoi::world &world, size_t &next)
 {
-	// blocks
-    //      
-	//      
-    // 2 1 0
-    // turn to move over the block 1
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait);
-    
-    // lower onto the block 1
-    move(0.237558, 0.237558, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.237558, 0.237558, towers::lift, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.237558, 0.237558, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.000000, 0.336000, towers::block0 + towers::drop,
-         0.000000, towers::pi / 2, towers::block1Grip);
-    sleep(towers::liftWait);
-    
-    // release the block
-    move(0.000000, 0.336000, towers::block0 + towers::drop,
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::gripWait);
-    
-    // lift the gripper
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-	// blocks
-    //      
-	//     1
-    // 2   0
+    if (last.numBlocks != towers::numBlocks || last.planIndex >= plan.size())
+        return false;
+
+    hanoi::world restored = checkpoint::restore(last);
+    hanoi::world check = restored;
+
+    // every move left in the cycle has to be legal from where the blocks are
+    for (size_t i = last.planIndex; i < plan.size(); i++)
+    {
+        if (!check.canMove(plan[i]))
+        {
+            ROS_WARN("The checkpoint does not match the plan, starting over.");
+            return false;
+        }
+        check.apply(plan[i]);
+    }
+
+    if (last.kind == checkpoint::beginMove)
+        ROS_WARN("Move %u was interrupted, check that its block is back on peg %d.",
+                 last.planIndex, plan[last.planIndex].from);
+
+    world = restored;
+    next = last.planIndex;
+    return true;
 }
 
-void move13()
+// Runs the plan with the wait times of the arm.
+template <class Arm>
+void run(checkpoint &log)
 {
-	// blocks
-    //      
-	//     1
-    // 2   0
-    // turn to move over the block 1
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::rotWait * 2);
-    
-    // lower onto the block 1
-    move(0.336000, 0.000000, towers::lift, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
-    
-    // close the hand on the block
-    move(0.336000, 0.000000, towers::lift, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::gripWait);
-    
-    // lift up the block
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-    
-    // move the block to pos
-    move(0.000000, 0.336000, towers::raised, 
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::rotWait);
-    
-    // lower the block
-    move(0.000000, 0.336000, towers::block0 + towers::block1 + towers::drop,
-         0.000000, towers::pi / 2, towers::block2Grip);
-    sleep(towers::liftWait);
-	// blocks
-    //     2
-	//     1
-    //     0
+    for (int i = 0; i < towers::numBlocks; i++)
+        if (towers::pegLayout.blockGrip[i] < Arm::table().minGrip || towers::pegLayout.blockGrip[i] > Arm::table().maxGrip)
+            ROS_WARN("The grip for block %d is outside of the %s grip range.", i, Arm::table().name);
+
+    timing::model timings(Arm::table());
+    towers::timings = &timings;
+    towers::full = search::referencesOf(towers::pegLayout, towers::numBlocks);
+
+    if (timings.load(towers::timingPath))
+        ROS_INFO("Loaded the %s wait times from %s.", Arm::table().name, towers::timingPath.c_str());
+
+    // a checkpoint is resumed with the plan it was written for, the learned times or the search may
+    // pick a different plan now
+    checkpoint::record last;
+    bool logged = log.load(last) && last.numBlocks == towers::numBlocks;
+    search::plan plan;
+
+    if (logged)
+        plan = rebuild<Arm>(last.plan, timings);
+    if (!logged || std::isinf(plan.cost))
+    {
+        logged = false;
+        plan = choose<Arm>(timings);
+    }
+
+    if (std::isinf(plan.cost))
+    {
+        ROS_ERROR("No plan can be done by the %s.", Arm::table().name);
+        return;
+    }
+
+    // the arm starts over the peg the plan ends on, at the transit height of the last move
+    hanoi::point over = towers::pegLayout.pegs[plan.moves.back().to];
+    hanoi::waypoint start = { over.x, over.y, plan.raised.back(), 0.000000, towers::pi / 2, towers::openGrip,
+                              hanoi::raiseSegment, -1 };
+    reach::target t = { start.x, start.y, start.z, start.roll, start.pitch, start.hand };
+    reach::status result = reach::check<Arm>(t, towers::clampTargets);
+
+    if (!reachable<Arm>(plan, hanoi::world(towers::numBlocks, 0)))
+        return;
+
+    if (result != reach::reachable && result != reach::clamped)
+    {
+        ROS_ERROR("The start (%f, %f, %f) can not be reached by the %s, %s.", start.x, start.y, start.z,
+                  Arm::table().name, reach::reason(result));
+        return;
+    }
+
+    start.x = t.x;
+    start.y = t.y;
+    start.z = t.z;
+    start.hand = t.hand;
+
+    hanoi::world world(towers::numBlocks, 0);
+    size_t next = 0;
+    bool resumed = logged && resume(last, plan.moves, world, next);
+
+    log.use(plan.opt);
+
+    if (resumed)
+    {
+        ROS_INFO("Resuming from move %zu.", next);
+
+        // only wait for the arm to be listening
+        for (int i = 0; i < towers::startupWait * 10 && towers::targets.getNumSubscribers() == 0; i++)
+            usleep(100000);
+    }
+    else
+    {
+        sleep(towers::startupWait);
+
+        // lift into place over the peg the plan ends on
+        move(t.x, t.y, t.z, t.roll, t.pitch, t.hand);
+        sleep(Arm::table().liftWait);
+        towers::last = start;
+        towers::known = true;
+    }
+
+    std::vector<hanoi::waypoint> path;
+
+    while (towers::enabled && ros::ok())
+    {
+        hanoi::move m = plan.moves[next];
+
+        if (!world.canMove(m))
+        {
+            ROS_ERROR("Move %zu from peg %d to %d is not legal, stopping.", next, m.from, m.to);
+            break;
+        }
+
+        path.clear();
+        search::expand(plan, next, world, towers::pegLayout, path);
+
+        log.begin(next, world);
+
+        // a move cut short is left as begun so a restart knows it was interrupted
+        bool completed = true;
+        for (size_t i = 0; i < path.size() && completed; i++)
+            completed = towers::enabled && ros::ok() && go<Arm>(path[i]);
+
+        if (!completed)
+            break;
+
+        world.apply(m);
+        next = (next + 1) % plan.moves.size();
+        log.commit(next, world);
+
+        if (!timings.save(towers::timingPath))
+            ROS_WARN_THROTTLE(60, "Could not save the wait times to %s.", towers::timingPath.c_str());
+
+        report(next == 0 ? plan.moves.size() : next, plan.moves.size());
+
+        // a tower is finished every half of the plan
+        if (next == 0 || next == plan.moves.size() / 2)
+            sleep(towers::showWait);
+    }
 }
 
 int main(int argc, char **argv)
@@ -790,33 +480,48 @@ int main(int argc, char **argv)
 
     towers::targets = nh.advertise<sac_msgs::Target>("/moveto", 1000);
     towers::hand = nh.advertise<sac_msgs::HandPos>("/handDriver", 1000);
+    towers::progress = nh.advertise<std_msgs::Int32MultiArray>("/jobProgress", 10);
 
-    sleep(15);
+    ros::NodeHandle pnh("~");
+    std::string checkpointPath;
+    pnh.param<std::string>("checkpoint", checkpointPath, "towers.checkpoint");
+    pnh.param("clamp_targets", towers::clampTargets, false);
 
-    // lift into place
-    move(0.336000, 0.000000, towers::raised, 
-         0.000000, towers::pi / 2, towers::openGrip);
-    sleep(towers::liftWait);
+    // there and back again, the plan search picks the goal peg unless ~goal is set
+    pnh.param("goal", towers::goal, -1);
+    pnh.param<std::string>("plan_cache", towers::planCache, "towers.plans");
 
-    move0start();
+    checkpoint log(checkpointPath);
+
+    if (!log.isOpen())
+        ROS_WARN("Could not open the checkpoint %s, %s, progress will not be saved.", checkpointPath.c_str(),
+                 log.notice().c_str());
+    else if (!log.notice().empty())
+        ROS_WARN("The checkpoint %s was reset, %s.", checkpointPath.c_str(), log.notice().c_str());
+
+    std::string arm;
+    pnh.param<std::string>("arm", arm, arms::defaultArm::table().name);
+
+    // the wait times are learned from the joint states and kept between runs
+    std::string jointStates;
+    double settleTime, settleTolerance;
+    pnh.param<std::string>("timing", towers::timingPath, arm + ".timing");
+    pnh.param<std::string>("joint_states", jointStates, "/joint_states");
+    pnh.param("settle_time", settleTime, 0.25);
+    pnh.param("settle_tolerance", settleTolerance, 0.001);
+
+    timing::settle feedback(settleTime, settleTolerance);
+    towers::feedback = &feedback;
+    ros::Subscriber jointSub = nh.subscribe(jointStates, 10, jointCallback);
+
+    bool known = arms::withArm(arm, [&](auto profile)
+    {
+        run<decltype(profile)>(log);
+    });
 
-    while (towers::enabled)
+    if (!known)
     {
-        move1();
-        move2();
-        move3();
-        move4();
-        move5();
-        move6();
-        sleep(10);
-        move7();
-        move8();
-        move9();
-        move10();
-        move11();
-        move12();
-        move13();
-        sleep(10);
-        move0();
+        ROS_ERROR("Unknown arm %s.", arm.c_str());
+        return 1;
     }
 }
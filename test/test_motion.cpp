@@ -0,0 +1,53 @@
+// checks a compiled motion program is refused when it can not be run safely
+#include "../src/helpers/motion.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Writes a program image with one pool value and the code words.
+std::string writeImage(const std::vector<uint32_t> &code)
+{
+    std::string path = testing::TempDir() + "motion_test.mbc";
+    FILE *file = std::fopen(path.c_str(), "wb");
+    motion::header h = { motion::magic, motion::version, 0, 1, (uint32_t)code.size() };
+    float pool = 0.5;
+
+    std::fwrite(&h, sizeof(h), 1, file);
+    std::fwrite(&pool, sizeof(pool), 1, file);
+    std::fwrite(&code[0], sizeof(uint32_t), code.size(), file);
+    std::fclose(file);
+
+    return path;
+}
+
+TEST(MotionImage, AcceptsAProgramEndingInEnd)
+{
+    motion::image program(writeImage({ motion::instruction(motion::opSleep), 0, motion::instruction(motion::opEnd) }));
+
+    EXPECT_TRUE(program.isValid());
+}
+
+TEST(MotionImage, RejectsALastOperandWhichReadsAsEnd)
+{
+    // pool index 0 is the same word as an end instruction
+    motion::image program(writeImage({ motion::instruction(motion::opSleep), 0 }));
+
+    EXPECT_FALSE(program.isValid());
+}
+
+TEST(MotionImage, RejectsAJumpIntoAnOperand)
+{
+    motion::image program(writeImage({ motion::instruction(motion::opSleep), 0, motion::instruction(motion::opJump), 1,
+                                       motion::instruction(motion::opEnd) }));
+
+    EXPECT_FALSE(program.isValid());
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}